@@ -1,14 +1,26 @@
 #include "pch.h"
 #include "dhfs4_1.h"
-
-static uint64_t currentPosition = 0;
-
-// Global variables for the I/O Disk case, because the DLL stays active until the disk is closed
+#include "dhfs4_1_index.h"
+#include "dhfs4_1_extents.h"
+#include "dhfs4_1_carver.h"
+#include "dhfs4_1_checkpoint.h"
+#include "dhfs4_1_progress.h"
+#include "dhfs4_1_dispatcher.h"
+#include "dhfs4_1_pipeline.h"
+#include "dhfs4_1_asyncreader.h"
+
+// Global variables for the I/O Disk case, because the DLL stays active until the disk is closed.
+// They are only written by XT_SectorIOInit and XT_SectorIODone, XT_FileIO just reads them from any thread.
 std::vector<DHFS4_1_Partition> partitionTable;
 DHFS4_1_DiskIOReader reader;
-uint64_t currentNItemID = -1;
-BOOL moreFragments = false;
-uint64_t moreFragmentsOffset = 0;
+DHFS4_1_IndexView diskIndex;
+
+// Resolved read contexts of all items XT_FileIO was called for, key is the nItemID
+std::unordered_map<LONG, DHFS4_1_ReadContext> readContexts;
+std::mutex readContextsMutex;
+
+// 64 MB of extent maps, enough for thousands of recordings
+DHFS4_1_ExtentCache extentCache(64ULL * 1024 * 1024);
 
 #pragma pack(2)
 struct DriveInfo {
@@ -22,29 +34,145 @@ struct DriveInfo {
 	LPVOID lpPrivate;
 };
 
-std::unique_ptr<BYTE[]> DHFS4_1_ItemReader::readSectors(uint64_t offset,uint64_t size)
+DHFS4_1_Buffer DHFS4_1_ItemReader::readSectors(uint64_t offset,uint64_t size)
 {
-	std::unique_ptr<BYTE[]> buffer(new BYTE[size * 512]);
-	ZeroMemory(buffer.get(), size);
-	XWF_Read(this->hItem, offset, buffer.get(), size * 512);
-	currentPosition += size * 512;
+	DHFS4_1_Buffer buffer = acquireBuffer(size * 512);
+	ZeroMemory(buffer.get(), size * 512);
+	readSectorsInto(offset, size, buffer.get());
 	return buffer;
 }
 
-std::unique_ptr<BYTE[]> DHFS4_1_DiskIOReader::readSectors(uint64_t offset, uint64_t size)
+BOOL DHFS4_1_ItemReader::readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer)
+{
+	DWORD bytesRead = XWF_Read(this->hItem, offset, buffer, size * 512);
+	return bytesRead == size * 512;
+}
+
+BOOL DHFS4_1_ItemReader::readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	// XWF_Read works on bytes, so nothing outside the range is read
+	DWORD bytesRead = XWF_Read(this->hItem, offset, buffer, length);
+	return bytesRead == length;
+}
+
+DHFS4_1_Buffer DHFS4_1_DiskIOReader::readSectors(uint64_t offset, uint64_t size)
 {
-	std::unique_ptr<BYTE[]> buffer(new BYTE[size * 512]);
-	ZeroMemory(buffer.get(), size);
-	XWF_SectorIO(this->nDrive, offset / 512, size, buffer.get(), 0);
-	currentPosition += size * 512;
+	DHFS4_1_Buffer buffer = acquireBuffer(size * 512);
+	ZeroMemory(buffer.get(), size * 512);
+	readSectorsInto(offset, size, buffer.get());
 	return buffer;
 }
 
+BOOL DHFS4_1_DiskIOReader::readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer)
+{
+	DWORD sectorsRead = XWF_SectorIO(this->nDrive, offset / 512, size, buffer, 0);
+	return sectorsRead == size;
+}
+
+BOOL DHFS4_1_DiskIOReader::readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	BOOL success = true;
+
+	while (length > 0)
+	{
+		uint64_t sectorOffset = offset % 512;
+		uint64_t copied = 0;
+
+		if (sectorOffset != 0 || length < 512)
+		{
+			// Unaligned head or tail, only this sector goes through the bounce buffer
+			BYTE bounceBuffer[512];
+			copied = min(512 - sectorOffset, length);
+
+			success = readSectorsInto(offset - sectorOffset, 1, bounceBuffer) && success;
+			memcpy(buffer, bounceBuffer + sectorOffset, copied);
+		}
+		else
+		{
+			// All whole sectors land directly in the buffer of the caller
+			copied = length - (length % 512);
+
+			success = readSectorsInto(offset, copied / 512, buffer) && success;
+		}
+
+		offset += copied;
+		buffer += copied;
+		length -= copied;
+	}
+	return success;
+}
+
+BOOL DHFS4_1_DiskIOReader::readVector(std::span<const DHFS4_1_ReadRequest> requests)
+{
+	return forEachReadRun(requests, SIZE_MAX, [&](std::span<const DHFS4_1_ReadRequest> run) -> BOOL
+		{
+			uint64_t offset = run[0].offset;
+			uint64_t length = 0;
+			BOOL contiguous = true;
+
+			for (const DHFS4_1_ReadRequest& request : run)
+			{
+				contiguous = contiguous && run[0].destination + length == request.destination;
+				length += request.length;
+			}
+
+			// Adjacent on the disk and in memory, like clusters in a row, is just one bigger read
+			if (contiguous)
+			{
+				return readBytesInto(offset, length, run[0].destination);
+			}
+
+			// Otherwise the sectors of the run are read once into a bounce buffer and copied out
+			uint64_t sectorOffset = offset % 512;
+			uint64_t sectorCount = (sectorOffset + length + 511) / 512;
+
+			if (sectorCount * 512 > DHFS4_1_BUFFER_CLUSTER_SIZE)
+			{
+				return DHFS_4_1_ReaderInterface::readVector(run);
+			}
+
+			DHFS4_1_Buffer buffer = acquireBuffer(sectorCount * 512);
+			BOOL success = readSectorsInto(offset - sectorOffset, sectorCount, buffer.get());
+
+			for (const DHFS4_1_ReadRequest& request : run)
+			{
+				memcpy(request.destination, buffer.get() + sectorOffset + (request.offset - offset), request.length);
+			}
+			return success;
+		});
+}
+
+// Progress bar and stop button of X-Ways for the parser core
+class DHFS4_1_XWFProgressHost : public DHFS4_1_ProgressHost
+{
+public:
+	void showProgress(const std::wstring& description)
+	{
+		XWF_ShowProgress(const_cast<wchar_t*>(description.c_str()), (0x04 | 0x08));
+	}
+
+	void setProgressPercentage(DWORD percent)
+	{
+		XWF_SetProgressPercentage(percent);
+	}
+
+	void hideProgress()
+	{
+		XWF_HideProgress();
+	}
+
+	BOOL shouldStop()
+	{
+		return XWF_ShouldStop();
+	}
+};
+
+static DHFS4_1_XWFProgressHost progressHost;
+
 LONG __stdcall XT_Init(CallerInfo info, DWORD nFlags, HANDLE hMainWnd, struct LicenseInfo* pLicInfo)
 {
 	XT_RetrieveFunctionPointers();
-
-	currentPosition = 0;
+	setProgressHost(&progressHost);
 
 	if (nFlags == XT_INIT_QUICKCHECK || nFlags == XT_INIT_ABOUTONLY) {
 
@@ -56,6 +184,10 @@ LONG __stdcall XT_Init(CallerInfo info, DWORD nFlags, HANDLE hMainWnd, struct Li
 
 LONG __stdcall XT_Done(void* lpReserved)
 {
+	DHFS4_1_BufferStatistics statistics = getBufferStatistics();
+	XWF_OutputMessage(std::format(L"DHFS4.1 I/O buffers: {} allocated, {} reused, {} freed, {} oversized",
+		statistics.allocations, statistics.reuses, statistics.frees, statistics.oversized).c_str(), 0);
+
 	XWF_OutputMessage(L"DHFS4.1 X-Tension done.", 0);
 	return 0;
 }
@@ -83,7 +215,7 @@ DWORD XT_SectorIOInit(struct DriveInfo* pDInfo)
 {
 	XWF_OutputMessage(L"Starting DHFS4.1 Disk I/O X-Tension", 0);
 
-	std::unique_ptr<BYTE[]> buffer(new BYTE[512]);
+	DHFS4_1_Buffer buffer = acquireBuffer(512);
 	ZeroMemory(buffer.get(), 512);
 
 	uint32_t dhfsId;
@@ -94,32 +226,106 @@ DWORD XT_SectorIOInit(struct DriveInfo* pDInfo)
 
 	if (dhfsId == 0x53464844)
 	{
-		currentPosition = 0;
+		resetStop();
 
 		reader.setNDrive(pDInfo->nDrive);
+		partitionTable.clear();
+		{
+			std::lock_guard<std::mutex> lock(readContextsMutex);
+			readContexts.clear();
+		}
+		extentCache.clear();
 
 		readPartitionTable(reader, partitionTable);
 		for (DHFS4_1_Partition& partition : partitionTable)
 		{
 			readBootSector(reader, partition);
+		}
 
-			std::wstring progressDescription = std::format(L"Read descriptor table of partition {}", partition.id);
-
-			XWF_ShowProgress((wchar_t*)progressDescription.c_str(), (0x04 | 0x08));
-			XWF_SetProgressPercentage(0);
+		// Reuse the index written by XT_ProcessItemEx if it belongs to this image
+		DHFS4_1_ImageIdentity identity;
+		identity.imageSize = pDInfo->nSectorCount * pDInfo->nBytesPerSector;
+		identity.bootHash = hashBootSectors(reader, partitionTable);
 
-			for (int i = 0; i < partition.bootsector.descriptorTableItemcount; i++)
+		for (const std::wstring& indexPath : getIndexPaths(identity))
+		{
+			if (diskIndex.map(indexPath, identity))
 			{
-				XWF_ShouldStop();
-				DHFS4_1_Descriptor descriptor;
-				// Only needed to get the free descriptors;
-				readDescriptorTable(reader, partition, i, descriptor);
-				XWF_SetProgressPercentage(DWORD((100. / partition.bootsector.descriptorTableItemcount) * i));
+				if (diskIndex.restorePartitions(partitionTable))
+				{
+					XWF_OutputMessage(std::format(L"Using DHFS4.1 index {}", indexPath).c_str(), 0);
+					return 0x11;
+				}
+				diskIndex.unmap();
 			}
-			XWF_HideProgress();
+		}
+
+		XWF_OutputMessage(L"No matching DHFS4.1 index found, scanning the whole disk", 0);
+
+		std::atomic<BOOL> stopped = false;
+		std::vector<std::function<void()>> workers;
+
+		for (DHFS4_1_Partition& partition : partitionTable)
+		{
+			workers.push_back([&partition, &stopped]
+				{
+					if (!loadDescriptorTable(reader, partition))
+					{
+						callOnHost([&] { XWF_OutputMessage(std::format(L"Couldn't read the descriptor table of partition {}", partition.id).c_str(), 0); });
+						stopped = true;
+						return;
+					}
+
+					std::vector<uint32_t> recordingIds;
 
-			carveFreeDescriptor(reader, partition);
-			carveSlackSpace(reader, partition);
+					{
+						DHFS4_1_Progress progress(std::format(L"Read descriptor table of partition {}", partition.id), partition.bootsector.descriptorTableItemcount);
+
+						for (int i = 0; i < partition.bootsector.descriptorTableItemcount; i++)
+						{
+							if (!progress.update(i))
+							{
+								stopped = true;
+								return;
+							}
+
+							DHFS4_1_Descriptor descriptor;
+							// Needed to get the free descriptors and the recordings
+							if (readDescriptorTable(reader, partition, i, descriptor))
+							{
+								recordingIds.push_back(i);
+							}
+						}
+					}
+
+					// XT_FileIO takes the video offsets from the partition instead of reading every header on the first access
+					uint64_t failedHeaders = 0;
+					if (!prefetchVideoOffsets(reader, partition, std::move(recordingIds), failedHeaders))
+					{
+						stopped = true;
+						return;
+					}
+
+					// A damaged disk is still carved, only these recordings read their header again on access
+					if (failedHeaders > 0)
+					{
+						callOnHost([&] { XWF_OutputMessage(std::format(L"Couldn't read {} video headers of partition {}", failedHeaders, partition.id).c_str(), 0); });
+					}
+
+					if (!carveFreeDescriptor(reader, partition) || !carveSlackSpace(reader, partition))
+					{
+						stopped = true;
+					}
+				});
+		}
+
+		// The partitions don't create items here, so the workers only read and carve
+		DHFS4_1_Dispatcher dispatcher;
+		dispatcher.run(std::format(L"Scan {} partitions", partitionTable.size()), workers, getCarveSettings().threadCount);
+
+		if (stopped)
+		{
+			XWF_OutputMessage(L"DHFS4.1 scan stopped, carved files may be missing", 0);
 		}
 		return 0x11;
 	}
@@ -133,1171 +339,701 @@ DWORD XT_SectorIO(LPVOID lpPrivate, LONG nDrive, INT64 nSector, DWORD nCount, LP
 
 DWORD XT_SectorIODone(LPVOID lpPrivate, LPVOID lpReserved)
 {
+	{
+		std::lock_guard<std::mutex> lock(readContextsMutex);
+		readContexts.clear();
+	}
+	extentCache.clear();
+	diskIndex.unmap();
+	partitionTable.clear();
 	return 0;
 }
 
-uint64_t getVideoOffset(uint64_t partitionOffset, uint64_t dataAreaOffset, uint64_t clusterSize, uint64_t descriptorId)
+// Only reads the header if the recording wasn't prefetched and isn't in the index
+uint32_t getVideoOffset(DHFS_4_1_ReaderInterface& reader, const DHFS4_1_Partition& partition, uint32_t descriptorId)
 {
-	uint32_t videoOffset = 0;
-	uint64_t oldPosition = currentPosition;
-
-	currentPosition = (partitionOffset + dataAreaOffset + clusterSize * descriptorId) * 512ULL;
-	std::unique_ptr<BYTE[]> buffer = reader.readSectors(currentPosition, 1);
-	uint64_t internalOffset = 64;
-	memcpy(&videoOffset, buffer.get() + internalOffset, 4);
+	auto found = partition.videoOffsets.find(descriptorId);
+	if (found != partition.videoOffsets.end())
+	{
+		return found->second;
+	}
 
-	currentPosition = oldPosition;
+	uint32_t videoOffset = 0;
+	if (diskIndex.isMapped() && diskIndex.findVideoOffset(partition.id, descriptorId, videoOffset))
+	{
+		return videoOffset;
+	}
+	return readVideoOffset(reader, partition, descriptorId);
+}
 
-	return videoOffset;
+// The descriptor table is only loaded after a full scan, otherwise the index knows the recording
+static BOOL lookupDescriptor(const DHFS4_1_Partition& partition, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor)
+{
+	if (!partition.descriptorTable.empty())
+	{
+		return resolveDescriptor(partition, descriptorId, descriptor);
+	}
+	return diskIndex.findRecording(partition.id, descriptorId, descriptor);
 }
 
-INT64 XT_FileIO(LPVOID lpPrivate, LONG nDrive, HANDLE hVolume, HANDLE hItem, LONG nItemID, INT64 nOffset, LPVOID lpBuffer, INT64 nNumberOfBytes, DWORD nFlags)
+// Parses the extracted metadata ("partition:descriptor", "partition:Carved:index" or "partition:Logfile") once
+static void buildReadContext(LONG nItemID, DHFS4_1_ReadContext& context)
 {
-	XWF_ShouldStop();
+	context.partition = nullptr;
+	context.kind = DHFS4_1_ItemKind::unknown;
+	context.descriptorId = 0;
+	context.videoOffset = 0;
+	context.logFileSize = 0;
+
 	LPWSTR lpMetaData = XWF_GetExtractedMetadata(nItemID);
 
 	if (lpMetaData == nullptr)
 	{
 		// Skip all data without added meta data
-		return -1;
+		return;
 	}
 
-	std::wstring metaData(lpMetaData);
-	uint8_t pos = metaData.find(L":");
-	
-	
-	if (nOffset >= 0 && pos != std::wstring::npos)
+	std::wstring_view metaData(lpMetaData);
+	size_t pos = metaData.find(L':');
+
+	if (pos == std::wstring_view::npos)
 	{
-		std::vector<std::wstring> parts;
+		return;
+	}
 
-		size_t start = 0, end;
-		while ((end = metaData.find(L":", start)) != std::wstring::npos)
-		{
-			parts.push_back(metaData.substr(start, end - start));
-			start = end + 1;
-		}
-		parts.push_back(metaData.substr(start));
+	uint32_t metaDataPartition = static_cast<uint32_t>(wcstoul(lpMetaData, nullptr, 10));
+
+	if (metaDataPartition >= partitionTable.size())
+	{
+		return;
+	}
 
-		uint32_t metaDataPartition = static_cast<uint32_t>(std::stoul(parts[0]));
+	const DHFS4_1_Partition& partition = partitionTable[metaDataPartition];
+	std::wstring_view itemType = metaData.substr(pos + 1);
 
-		DHFS4_1_Partition partition = partitionTable[metaDataPartition];
-		uint64_t clusterSize = partition.bootsector.clusterSize;
-		uint64_t dataAreaOffset = partition.bootsector.dataAreaOffset;
-		uint64_t partitionOffset = partition.partitionOffset;
+	if (itemType == L"Logfile")
+	{
+		uint64_t logOffset = (partition.partitionOffset + partition.bootsector.logsOffset) * 512ULL;
+
+		DHFS4_1_Buffer buffer = reader.readSectors(logOffset, 1);
+		memcpy(&context.logFileSize, buffer.get(), 4);
 
-		std::unique_ptr<BYTE[]> byteBuffer(new BYTE[nNumberOfBytes]);
-		uint64_t bufferOffset = 0;
-		uint64_t fragmentID = 0;
-		uint64_t fragmentOffset = 0;
-		uint64_t maxRead = nNumberOfBytes;
+		context.kind = DHFS4_1_ItemKind::logfile;
+	}
+	else if (itemType.starts_with(L"Carved:"))
+	{
+		uint32_t index = static_cast<uint32_t>(wcstoul(lpMetaData + pos + 1 + 7, nullptr, 10));
 
-		if (currentNItemID != nItemID)
+		if (index >= partition.carvedDescriptors.size())
 		{
-			currentNItemID = nItemID;
-			moreFragmentsOffset = 0;
+			return;
 		}
 
-		if (parts[1] == L"Logfile")
+		context.descriptorId = index;
+		context.kind = DHFS4_1_ItemKind::carved;
+	}
+	else
+	{
+		uint32_t descriptorId = static_cast<uint32_t>(wcstoul(lpMetaData + pos + 1, nullptr, 10));
+
+		DHFS4_1_Descriptor descriptor;
+
+		if (!lookupDescriptor(partition, descriptorId, descriptor))
 		{
-			uint32_t logFileSize = 0;
+			return;
+		}
 
-			currentPosition = (partition.partitionOffset + partition.bootsector.logsOffset) * 512ULL;
+		context.videoOffset = getVideoOffset(reader, partition, descriptorId);
+		context.descriptorId = descriptorId;
+		context.kind = DHFS4_1_ItemKind::recording;
+	}
 
-			std::unique_ptr<BYTE[]> buffer = reader.readSectors(currentPosition, 1);
-			memcpy(&logFileSize, buffer.get(), 4);
+	context.partition = &partition;
+}
 
-			while (maxRead > 0)
-			{
-				uint64_t offset = nOffset + bufferOffset + moreFragmentsOffset;
-				uint64_t sectorSize = (logFileSize + 511) / 512;
-				currentPosition = (partition.partitionOffset + partition.bootsector.logsOffset + 2) * 512ULL;
-				std::unique_ptr<BYTE[]> logBuffer = reader.readSectors((currentPosition), sectorSize);
-				memcpy(byteBuffer.get() + bufferOffset, logBuffer.get() + offset, maxRead);
-				bufferOffset += maxRead;
-				maxRead -= maxRead;
-			}
-		}
-		else if (parts[1] == L"Carved")
+// Contexts are never removed until the disk is closed, so the returned pointer stays valid
+static const DHFS4_1_ReadContext* getReadContext(LONG nItemID)
+{
+	{
+		std::lock_guard<std::mutex> lock(readContextsMutex);
+		auto found = readContexts.find(nItemID);
+		if (found != readContexts.end())
 		{
-			uint32_t index = static_cast<uint32_t>(std::stoul(parts[2]));
+			return &found->second;
+		}
+	}
 
-			DHFS4_1_Descriptor descriptor = partition.carvedDescriptors[index];
+	DHFS4_1_ReadContext context;
+	buildReadContext(nItemID, context);
 
-			struct BinarySearchElement {
-				uint32_t length;
-				uint64_t startInStream;
-			};
+	std::lock_guard<std::mutex> lock(readContextsMutex);
+	return &readContexts.try_emplace(nItemID, std::move(context)).first->second;
+}
 
-			while (maxRead > 0)
-			{
-				XWF_ShouldStop();
-				uint64_t offset = nOffset + bufferOffset + moreFragmentsOffset;
+// Built from the in-memory descriptor table or index, so a rebuild after eviction needs no I/O
+static std::shared_ptr<const DHFS4_1_ExtentMap> getExtentMap(LONG nItemID, const DHFS4_1_ReadContext& context)
+{
+	std::shared_ptr<const DHFS4_1_ExtentMap> extentMap = extentCache.get(nItemID);
 
-				uint64_t slidingWindow = 0;
-				uint64_t fragmentIndex = 0;
+	if (extentMap != nullptr)
+	{
+		return extentMap;
+	}
 
-				size_t low = 0, high = descriptor.videoFragments.size();
+	const DHFS4_1_Partition& partition = *context.partition;
+	std::shared_ptr<DHFS4_1_ExtentMap> newExtentMap = std::make_shared<DHFS4_1_ExtentMap>();
 
-				// More efficient method of traversing the fragment list, instead O(n) its O(log n)...
-				while (low < high)
-				{
-					size_t mid = (low + high) / 2;
-					const auto& element = descriptor.videoFragments[mid];
-					if (offset < element.offsetInStream)
-					{
-						high = mid;
-					}
-					else if (offset >= element.offsetInStream + element.fragmentSize)
-					{
-						low = mid + 1;
-					}
-					else
-					{
-						fragmentIndex = mid;
-						// If the index is 0, the start is 0. So this prevents a division by 0
-						fragmentOffset = mid > 0 ? offset % element.offsetInStream : offset % element.fragmentSize;
-						break;
-					}
-				}
-				currentPosition = (partitionOffset + dataAreaOffset + descriptor.videoFragments[fragmentIndex].mainDescriptorId * clusterSize) * 512;
+	if (context.kind == DHFS4_1_ItemKind::logfile)
+	{
+		newExtentMap->append((partition.partitionOffset + partition.bootsector.logsOffset + 2) * 512ULL, context.logFileSize);
+	}
+	else if (context.kind == DHFS4_1_ItemKind::carved)
+	{
+		*newExtentMap = buildCarvedExtents(partition, partition.carvedDescriptors[context.descriptorId]);
+	}
+	else
+	{
+		DHFS4_1_Descriptor descriptor;
 
-				std::unique_ptr<BYTE[]> videoBuffer = reader.readSectors((currentPosition), clusterSize);
-				memcpy(byteBuffer.get() + bufferOffset, videoBuffer.get() + descriptor.videoFragments[fragmentIndex].offset + fragmentOffset, min(descriptor.videoFragments[fragmentIndex].fragmentSize - fragmentOffset, maxRead));
-				bufferOffset += min(descriptor.videoFragments[fragmentIndex].fragmentSize - fragmentOffset, maxRead);
-				maxRead -= min(descriptor.videoFragments[fragmentIndex].fragmentSize - fragmentOffset, maxRead);
-			}
-		}
-		else
+		if (lookupDescriptor(partition, context.descriptorId, descriptor))
 		{
-			uint32_t descriptorId = static_cast<uint32_t>(std::stoul(parts[1]));
-
-			DHFS4_1_Descriptor descriptor;
-
-			readDescriptorTable(reader, partition, descriptorId, descriptor);
+			*newExtentMap = buildRecordingExtents(partition, descriptor, context.videoOffset);
+		}
+	}
 
-			std::vector<DHFS4_1_VideoFragment> videoFragments = descriptor.videoFragments;
-			uint32_t videoOffset = 0;
+	extentCache.put(nItemID, newExtentMap);
+	return newExtentMap;
+}
 
-			if (descriptor.status != DHF4_1_DescriptorStatus::carved)
-			{
-				videoOffset = getVideoOffset(partitionOffset, dataAreaOffset, clusterSize, descriptorId);
-			}
+INT64 XT_FileIO(LPVOID lpPrivate, LONG nDrive, HANDLE hVolume, HANDLE hItem, LONG nItemID, INT64 nOffset, LPVOID lpBuffer, INT64 nNumberOfBytes, DWORD nFlags)
+{
+	const DHFS4_1_ReadContext* context = getReadContext(nItemID);
 
-			while (maxRead > 0)
-			{
-				XWF_ShouldStop();
-				uint64_t offset = nOffset + videoOffset + bufferOffset + moreFragmentsOffset;
+	if (context->kind == DHFS4_1_ItemKind::unknown || nOffset < 0)
+	{
+		return -1;
+	}
 
-				uint64_t fragmentID = offset / (clusterSize * 512);
-				uint64_t fragmentOffset = offset % (clusterSize * 512);
+	std::shared_ptr<const DHFS4_1_ExtentMap> extentMap = getExtentMap(nItemID, *context);
 
-				currentPosition = (partitionOffset + dataAreaOffset + clusterSize * videoFragments[fragmentID].id) * 512;
+	BYTE* destination = static_cast<BYTE*>(lpBuffer);
+	uint64_t bufferOffset = 0;
+	uint64_t offset = nOffset;
 
-				if (fragmentID == videoFragments.size() - 1)
-				{
-					clusterSize = descriptor.lastFragmentSize;
-				}
+	// Only nOffset decides what is read, so any number of threads can read any items in any order
+	if (offset >= extentMap->size || nNumberOfBytes <= 0)
+	{
+		return 0;
+	}
+	uint64_t maxRead = min(uint64_t(nNumberOfBytes), extentMap->size - offset);
 
-				std::unique_ptr<BYTE[]> videoBuffer = reader.readSectors((currentPosition), clusterSize);
-				memcpy(byteBuffer.get() + bufferOffset, videoBuffer.get() + fragmentOffset, min((clusterSize * 512 - fragmentOffset), maxRead));
-				bufferOffset += min((clusterSize * 512 - fragmentOffset), maxRead);
-				maxRead -= min((clusterSize * 512 - fragmentOffset), maxRead);
-			}
-		}
+	// Stopped by the user, nothing is read anymore
+	if (shouldStop())
+	{
+		return 0;
+	}
 
-		memcpy(lpBuffer, byteBuffer.get(), min(nNumberOfBytes, bufferOffset));
+	std::vector<DHFS4_1_ReadRequest> requests;
 
-		moreFragmentsOffset += min(nNumberOfBytes, bufferOffset);
+	// One binary search for the first extent, all following extents are just the next ones
+	for (size_t index = extentMap->find(offset); index < extentMap->extents.size() && maxRead > 0; index++)
+	{
+		const DHFS4_1_Extent& extent = extentMap->extents[index];
+		uint64_t extentOffset = offset + bufferOffset - extent.logicalOffset;
+		uint64_t length = min(extent.length - extentOffset, maxRead);
 
-		// End of file reached
-		// No more following fragments
-		if (moreFragmentsOffset >= XWF_GetItemSize(nItemID))
-		{
-			moreFragmentsOffset = 0;
-		}
+		// Only the sectors covering the requested bytes are read, never a whole cluster
+		requests.push_back({ extent.physicalOffset + extentOffset, length, destination + bufferOffset });
 
-		// No more following fragments
-		// 8388608 = 8MB, the maximum chunk size X-Ways can read per call of XT_FileIO
-		// If nNumberOfBytes is less then 8 MB no more fragments are following
-		if (nNumberOfBytes < 8388608)
-		{
-			moreFragmentsOffset = 0;
-		}
+		bufferOffset += length;
+		maxRead -= length;
+	}
 
-		// If returned exactly 8 MB and the file size is bigger then
-		// the bytes still open to read, more fragments will follow
-		return min(bufferOffset, nNumberOfBytes);
+	// All pieces in one vectored read, the reader merges the ones adjacent on the disk.
+	// It doesn't tell which piece failed, so a read error fails the whole call instead of passing on zeroed bytes.
+	if (!reader.readVector(requests))
+	{
+		return -1;
 	}
+
+	return bufferOffset;
 }
 
-LONG XT_ProcessItemEx(LONG nItemID, HANDLE hItem, PVOID lpReserved)
+// Reads, carves and creates the items of one partition for XT_ProcessItemEx, returns false if it was stopped.
+// Runs on a partition worker, so every X-Tension call goes through callOnHost.
+static BOOL processPartition(DHFS4_1_ItemReader& reader, DHFS4_1_Partition& partition, DHFS4_1_Checkpoint& checkpoint, DHFS4_1_IndexWriter& indexWriter)
 {
-	XWF_OutputMessage(L"Starting DHFS4.1 Filetree X-Tension", 0);
-	XWF_ShouldStop();
-
-	std::vector<DHFS4_1_Partition> partitionTable;
-	DHFS4_1_ItemReader reader;	
-	reader.setHandle(hItem);
-
-	uint32_t dhfsId;
-
-	currentPosition = 0;
-	std::unique_ptr<BYTE[]> buffer = reader.readSectors(currentPosition, 1);
+	if (shouldStop())
+	{
+		return false;
+	}
 
-	memcpy(&dhfsId, buffer.get(), 4);
+	DHFS4_1_PartitionCheckpoint& state = checkpoint.getPartition(partition.id);
+	BOOL stopped = false;
 
-	if (dhfsId == 0x53464844)
+	// Without the whole table recordings would be missing, the run is continued from the checkpoint like after a stop
+	if (!loadDescriptorTable(reader, partition))
 	{
-		currentPosition = 0;
+		callOnHost([&] { XWF_OutputMessage(std::format(L"Couldn't read the descriptor table of partition {}", partition.id).c_str(), 0); });
+		return false;
+	}
 
-		readPartitionTable(reader, partitionTable);
+	// The table is classified and the chains resolved on a background thread, the DHII headers of each
+	// batch are read in disk order. Meanwhile the items of the batches before are created on the host thread.
+	DHFS4_1_BoundedQueue<DHFS4_1_RecordingBatch> queue(DHFS4_1_PIPELINE_DEPTH);
+	std::chrono::nanoseconds decodeTime(0);
+	std::chrono::nanoseconds readTime(0);
+	std::chrono::nanoseconds createTime(0);
+	uint64_t recordingCount = 0;
+	uint64_t failedHeaders = 0;
 
-		for (DHFS4_1_Partition& partition : partitionTable)
+	std::thread producer([&]
 		{
-			XWF_ShouldStop();
-
-			readBootSector(reader, partition);
-
-			std::wstring progressDescription = std::format(L"Read descriptortable of partition {}", partition.id);
-
-			XWF_ShowProgress((wchar_t*)progressDescription.c_str(), (0x04 | 0x08));
-			XWF_SetProgressPercentage(0);
-
-			std::wstring folderName = std::format(L"Partition {}", partition.id);
-			int rootId = XWF_CreateItem(const_cast<LPWSTR>(folderName.c_str()), 0x00000001);
-			XWF_SetItemInformation(rootId, XWF_ITEM_INFO_FLAGS, 0x00000001);
-			XWF_SetItemParent(rootId, 0);
-			partition.rootId = rootId;
-			int fileCounter = 0;
+			uint64_t itemCount = partition.bootsector.descriptorTableItemcount;
+			std::unique_ptr<DHFS4_1_AsyncReader> asyncReader;
+			std::vector<uint32_t> descriptorIds;
 
-			for (int i = 0; i < partition.bootsector.descriptorTableItemcount; i++)
+			for (uint64_t i = 0; i < itemCount;)
 			{
-				XWF_ShouldStop();
+				DHFS4_1_RecordingBatch batch;
+				batch.descriptors.reserve(DHFS4_1_PIPELINE_BATCH);
 
-				DHFS4_1_Descriptor descriptor;
-				BOOL success = readDescriptorTable(reader, partition, i, descriptor);
+				// The whole table is classified again, the free clusters and the index need all descriptors
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (; i < itemCount && batch.descriptors.size() < DHFS4_1_PIPELINE_BATCH; i++)
+				{
+					DHFS4_1_Descriptor descriptor;
+					if (readDescriptorTable(reader, partition, i, descriptor))
+					{
+						batch.descriptors.push_back(std::move(descriptor));
+					}
+				}
 
-				if (success)
+				// The ids are ascending, so the headers are read in disk order with the reads in flight
+				std::chrono::steady_clock::time_point decoded = std::chrono::steady_clock::now();
+				descriptorIds.clear();
+				for (const DHFS4_1_Descriptor& descriptor : batch.descriptors)
 				{
-					createVSItems(reader, partition, descriptor);
-					fileCounter++;
+					descriptorIds.push_back(uint32_t(descriptor.id));
 				}
+				readVideoOffsets(reader, partition, descriptorIds, asyncReader, batch.videoOffsets, batch.failedReads, {});
+				failedHeaders += std::count(batch.failedReads.begin(), batch.failedReads.end(), 1);
 
-				XWF_SetProgressPercentage(DWORD((100. / partition.bootsector.descriptorTableItemcount) * i));
+				decodeTime += decoded - start;
+				readTime += std::chrono::steady_clock::now() - decoded;
+				recordingCount += batch.descriptors.size();
+
+				if (!batch.descriptors.empty() && !queue.push(std::move(batch)))
+				{
+					break;
+				}
 			}
+			queue.close();
+		});
 
-			XWF_HideProgress();
+	DHFS4_1_Progress progress(std::format(L"Read descriptortable of partition {}", partition.id), partition.bootsector.descriptorTableItemcount);
+	DHFS4_1_RecordingBatch batch;
 
-			carveFreeDescriptor(reader, partition);
-			carveSlackSpace(reader, partition);
+	// One host call per batch, so the host thread runs the calls of the other partitions in between
+	while (!stopped && queue.pop(batch))
+	{
+		if (!progress.update(batch.descriptors.front().id))
+		{
+			stopped = true;
+			queue.cancel();
+			break;
+		}
 
-			std::wstring carvedFolderName = L"Carved";
-			int carvedRootId = XWF_CreateItem(const_cast<LPWSTR>(carvedFolderName.c_str()), 0x00000001);
-			XWF_SetItemInformation(carvedRootId, XWF_ITEM_INFO_FLAGS, 0x00000001);
-			XWF_SetItemParent(carvedRootId, partition.rootId);
-			partition.carvedRootId = carvedRootId;
-			int carvedFileCounter = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-			for (int i = 0; i < partition.carvedDescriptors.size(); i++)
+		callOnHost([&]
 			{
-				createVSCarvedItems(reader, partition, partition.carvedDescriptors[i], i);
-				carvedFileCounter++;
-			}
+				for (size_t i = 0; i < batch.descriptors.size(); i++)
+				{
+					if (shouldStop())
+					{
+						stopped = true;
+						queue.cancel();
+						return;
+					}
 
-			uint32_t logFileSize = 0;
-			const std::wstring logType = std::wstring(L"txt\0");
+					// Without a video offset getVideoOffset reads the header again, the index marks it as missing
+					const DHFS4_1_Descriptor& descriptor = batch.descriptors[i];
+					if (!batch.failedReads[i])
+					{
+						partition.videoOffsets.emplace(uint32_t(descriptor.id), batch.videoOffsets[i]);
+					}
+					indexWriter.addRecording(partition, descriptor);
+
+					std::lock_guard<std::recursive_mutex> lock(checkpoint.getMutex());
+					if (descriptor.id >= state.nextDescriptor)
+					{
+						createVSItems(reader, partition, descriptor);
+						state.fileCounter++;
+						state.nextDescriptor = descriptor.id + 1;
+						checkpoint.save();
+					}
+				}
+			});
+
+		createTime += std::chrono::steady_clock::now() - start;
+	}
 
-			currentPosition = (partition.partitionOffset + partition.bootsector.logsOffset) * 512ULL;
+	producer.join();
 
-			std::unique_ptr<BYTE[]> logBuffer = reader.readSectors(currentPosition, 1);
-			memcpy(&logFileSize, logBuffer.get(), 4);
+	DHFS4_1_QueueStats stats = queue.getStats();
+	callOnHost([&]
+		{
+			auto milliseconds = [](std::chrono::nanoseconds time) { return std::chrono::duration_cast<std::chrono::milliseconds>(time).count(); };
 
-			std::wstring logFileName = std::format(L"Part_{}_Logfile.txt", partition.id);
-			int logFiledId = XWF_CreateItem(const_cast<LPWSTR>(logFileName.c_str()), 0x00000001);
+			XWF_OutputMessage(std::format(L"Partition {}: {} recordings, decoding {} ms, header reads {} ms, item creation {} ms, queue depth {:.1f} average {} max, decoding waited {} ms, item creation waited {} ms",
+				partition.id, recordingCount, milliseconds(decodeTime), milliseconds(readTime), milliseconds(createTime),
+				stats.batches > 0 ? double(stats.depthSum) / stats.batches : 0., stats.maxDepth,
+				milliseconds(stats.producerWait), milliseconds(stats.consumerWait)).c_str(), 0);
 
-			if (logFiledId != -1)
+			if (failedHeaders > 0)
 			{
-				XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(partition.bootsector.beginTime));
-				XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(partition.bootsector.endTime));
-				XWF_SetItemSize(logFiledId, logFileSize);
-
-				XWF_SetItemType(logFiledId, const_cast <LPWSTR>(logType.c_str()), 3);
-				std::wstring metaData = std::to_wstring(partition.id) + L":" + L"Logfile";
-				XWF_AddExtractedMetadata(logFiledId, &metaData[0], 0x01);
-				XWF_SetItemParent(logFiledId, partition.rootId);
-				XWF_SetItemOfs(logFiledId, (-1) * ((partition.partitionOffset + partition.bootsector.logsOffset + 2) * 512ULL), ((partition.partitionOffset + partition.bootsector.logsOffset + 2)));
+				XWF_OutputMessage(std::format(L"Couldn't read {} video headers of partition {}", failedHeaders, partition.id).c_str(), 0);
 			}
+		});
 
-			XWF_SetItemInformation(carvedRootId, XWF_ITEM_INFO_FILECOUNT, carvedFileCounter);
-			XWF_SetItemInformation(rootId, XWF_ITEM_INFO_FILECOUNT, fileCounter + 1);
-			XWF_SetItemInformation(0, XWF_ITEM_INFO_FLAGS, 0x00000002);
-		}
-	}
-	else
+	if (stopped)
 	{
-		XWF_OutputMessage(L"Wrong Dahua signature!", 0);
+		return false;
 	}
 
-	return 0;
-}
+	{
+		std::lock_guard<std::recursive_mutex> lock(checkpoint.getMutex());
 
-DWORD createVSItems(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_Descriptor descriptor)
-{
-	const std::wstring itemType = std::wstring(L"dav\0");
+		if (state.nextDescriptor < partition.bootsector.descriptorTableItemcount)
+		{
+			state.nextDescriptor = partition.bootsector.descriptorTableItemcount;
+		}
 
-	uint32_t descriptorId = descriptor.id;
-	uint32_t videoOffset = 0;
-
-	if (descriptor.status != DHF4_1_DescriptorStatus::carved)
-	{
-		// Calculating "real" offset by parsing the header of the DHII structure of the .DAV videofiles
-		// Skip 64 bytes and read the next 4 byte to get the offset of the first videoframe
-		// Without the calculation the video is still playable but not controlable by the timeline of the videoplayer
-		uint64_t oldPosition = currentPosition;
-
-		currentPosition = (partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL;
-		std::unique_ptr<BYTE[]> buffer = reader.readSectors(currentPosition, 1);
-		uint64_t internalOffset = 64;
-		memcpy(&videoOffset, buffer.get() + internalOffset, 4);
-		currentPosition = oldPosition;
+		if (state.phase == DHFS4_1_ScanPhase::descriptors)
+		{
+			state.phase = DHFS4_1_ScanPhase::freeClusters;
+			checkpoint.save(true);
+		}
 	}
-	
-	std::vector<DHFS4_1_VideoFragment> videoFragments = descriptor.videoFragments;
 
-	uint64_t totalFragmentSize = 0;
-	for (const DHFS4_1_VideoFragment& videoFragment : videoFragments)
+	if (!carveFreeDescriptor(reader, partition, &checkpoint) || !carveSlackSpace(reader, partition, &checkpoint))
 	{
-		totalFragmentSize += videoFragment.fragmentSize;
+		return false;
 	}
 
-	uint64_t fileSize = (totalFragmentSize) * 512ULL - videoOffset;
-
-	std::wstring fileName = std::format(L"Ch_{}_{}-{}.dav", descriptor.camera, dhfstimeToWString(descriptor.beginDate), dhfstimeToWString(descriptor.endDate));
-	int childId = XWF_CreateItem(const_cast<LPWSTR>(fileName.c_str()), 0x00000001);
-	XWF_SetItemInformation(childId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(descriptor.beginDate));
-	XWF_SetItemInformation(childId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(descriptor.endDate));
-	XWF_SetItemSize(childId, fileSize);
-	XWF_SetItemType(childId, const_cast <LPWSTR>(itemType.c_str()), 3);
-	std::wstring metaData = std::to_wstring(partition.id) + L":" + std::to_wstring(descriptorId);
-	XWF_AddExtractedMetadata(childId, &metaData[0], 0x01);
-	XWF_SetItemParent(childId, partition.rootId);
-
-	XWF_SetItemOfs(childId, (-1) * ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL + videoOffset), ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) + videoOffset / 512));
-
-	return 0;
-}
-
-DWORD createVSCarvedItems(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_Descriptor descriptor, uint64_t index)
-{
-	const std::wstring itemType = std::wstring(L"dav\0");
-
-	uint32_t descriptorId = descriptor.id;
-
-	std::vector<DHFS4_1_VideoFragment> videoFragments = descriptor.videoFragments;
+	callOnHost([&]
+		{
+			indexWriter.addCarvedDescriptors(partition);
 
-	uint64_t totalFragmentSize = 0;
+			std::lock_guard<std::recursive_mutex> lock(checkpoint.getMutex());
 
-	if (videoFragments.size() == 0)
-	{
-		return 0;
-	}
-
-	for (const DHFS4_1_VideoFragment& videoFragment : videoFragments)
-	{
-		totalFragmentSize += videoFragment.fragmentSize;
-	}
+			if (state.carvedRootId == -1)
+			{
+				std::wstring carvedFolderName = L"Carved";
+				state.carvedRootId = XWF_CreateItem(const_cast<LPWSTR>(carvedFolderName.c_str()), 0x00000001);
+				XWF_SetItemInformation(state.carvedRootId, XWF_ITEM_INFO_FLAGS, 0x00000001);
+				XWF_SetItemParent(state.carvedRootId, partition.rootId);
+			}
+			partition.carvedRootId = state.carvedRootId;
 
-	uint64_t fileSize = totalFragmentSize;
+			for (size_t i = size_t(state.carvedItemsDone); i < partition.carvedDescriptors.size(); i++)
+			{
+				if (shouldStop())
+				{
+					stopped = true;
+					return;
+				}
 
-	std::wstring fileName = std::format(L"Ch_{}_{}-{}.dav", descriptor.camera, dhfstimeToWString(descriptor.beginDate), dhfstimeToWString(descriptor.endDate));
-	int childId = XWF_CreateItem(const_cast<LPWSTR>(fileName.c_str()), 0x00000001);
-	XWF_SetItemInformation(childId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(descriptor.beginDate));
-	XWF_SetItemInformation(childId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(descriptor.endDate));
-	XWF_SetItemSize(childId, fileSize);
-	XWF_SetItemType(childId, const_cast <LPWSTR>(itemType.c_str()), 3);
-	std::wstring metaData = std::to_wstring(partition.id) + L":" + L"Carved:" + std::to_wstring(index);
-	XWF_AddExtractedMetadata(childId, &metaData[0], 0x01);
-	XWF_SetItemParent(childId, partition.carvedRootId);
+				createVSCarvedItems(reader, partition, partition.carvedDescriptors[i], i);
+				state.carvedItemsDone = i + 1;
+				checkpoint.save();
+			}
 
-	XWF_SetItemOfs(childId, (-1) * ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL + videoFragments[0].offset), ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) + videoFragments[0].offset / 512));
+			if (state.phase != DHFS4_1_ScanPhase::done)
+			{
+				uint32_t logFileSize = 0;
+				const std::wstring logType = std::wstring(L"txt\0");
 
-	return 0;
-}
+				uint64_t logOffset = (partition.partitionOffset + partition.bootsector.logsOffset) * 512ULL;
 
-DWORD createVSLogfile(DHFS4_1_Partition partition)
-{
-	uint32_t logFileSize = 0;
-	const std::wstring logType = std::wstring(L"txt\0");
+				DHFS4_1_Buffer logBuffer = reader.readSectors(logOffset, 1);
+				memcpy(&logFileSize, logBuffer.get(), 4);
 
-	currentPosition = (partition.partitionOffset + partition.bootsector.logsOffset) * 512ULL;
+				std::wstring logFileName = std::format(L"Part_{}_Logfile.txt", partition.id);
+				int logFiledId = XWF_CreateItem(const_cast<LPWSTR>(logFileName.c_str()), 0x00000001);
 
-	std::unique_ptr<BYTE[]> logBuffer = reader.readSectors(currentPosition, 1);
-	memcpy(&logFileSize, logBuffer.get(), 4);
+				if (logFiledId != -1)
+				{
+					XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(partition.bootsector.beginTime));
+					XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(partition.bootsector.endTime));
+					XWF_SetItemSize(logFiledId, logFileSize);
+
+					XWF_SetItemType(logFiledId, const_cast <LPWSTR>(logType.c_str()), 3);
+					std::wstring metaData = std::to_wstring(partition.id) + L":" + L"Logfile";
+					XWF_AddExtractedMetadata(logFiledId, &metaData[0], 0x01);
+					XWF_SetItemParent(logFiledId, partition.rootId);
+					XWF_SetItemOfs(logFiledId, (-1) * ((partition.partitionOffset + partition.bootsector.logsOffset + 2) * 512ULL), ((partition.partitionOffset + partition.bootsector.logsOffset + 2)));
+				}
 
-	std::wstring logFileName = std::format(L"Part_{}_Logfile.txt", partition.id);
-	int logFiledId = XWF_CreateItem(const_cast<LPWSTR>(logFileName.c_str()), 0x00000001);
+				XWF_SetItemInformation(state.carvedRootId, XWF_ITEM_INFO_FILECOUNT, state.carvedItemsDone);
+				XWF_SetItemInformation(state.rootId, XWF_ITEM_INFO_FILECOUNT, state.fileCounter + 1);
+				XWF_SetItemInformation(0, XWF_ITEM_INFO_FLAGS, 0x00000002);
 
-	if (logFiledId != -1)
-	{
-		XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(partition.bootsector.beginTime));
-		XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(partition.bootsector.endTime));
-		XWF_SetItemSize(logFiledId, logFileSize);
+				state.phase = DHFS4_1_ScanPhase::done;
+				checkpoint.save(true);
+			}
+		});
 
-		XWF_SetItemType(logFiledId, const_cast <LPWSTR>(logType.c_str()), 3);
-		std::wstring metaData = std::to_wstring(partition.id) + L":" + L"Logfile";
-		XWF_AddExtractedMetadata(logFiledId, &metaData[0], 0x01);
-		XWF_SetItemParent(logFiledId, partition.rootId);
-		XWF_SetItemOfs(logFiledId, (-1) * ((partition.partitionOffset + partition.bootsector.logsOffset + 2) * 512ULL), ((partition.partitionOffset + partition.bootsector.logsOffset + 2)));
-		return 0;
-	}
-	return -1;
+	return !stopped;
 }
 
-void readPartitionTable(DHFS_4_1_ReaderInterface& reader, std::vector<DHFS4_1_Partition>& partitionTable)
+// The item exists in the current volume snapshot with the name and parent the run gave it
+static BOOL isOwnItem(LONG itemId, const std::wstring& name, LONG parentId)
 {
-	XWF_ShouldStop();
-
-	// Skip 30 sectors
-	currentPosition = 30 * 512ULL;
-	uint64_t internalOffset = 0;
-
-	std::unique_ptr<BYTE[]> buffer = reader.readSectors(currentPosition, 1);
-	
-	internalOffset += 64;
-
-	uint32_t endSignatur = 0;
-	int i = 0;
-
-	for (int i = 0; endSignatur != 0x55AA55AA; i++)
+	if (itemId < 0 || DWORD(itemId) >= XWF_GetItemCount(NULL))
 	{
-		DHFS4_1_Partition partition;
-
-		memcpy(&partition.id, &i, 8);
-
-		internalOffset += 8;
-
-		memcpy(&partition.bootSectorOffset, buffer.get() + internalOffset, 4);
-		internalOffset += 4;
-
-		internalOffset += 24;
-
-		memcpy(&partition.partitionOffset, buffer.get() + internalOffset, 8);
-		internalOffset += 8;
-
-		memcpy(&partition.length, buffer.get() + internalOffset, 4);
-		internalOffset += 4;
-
-		internalOffset += 4;
-
-		memcpy(&endSignatur, buffer.get() + internalOffset, 4);
-		internalOffset += 4;
-
-		internalOffset += 8;
-
-		partitionTable.push_back(partition);
+		return false;
 	}
-}
-
-void readBootSector(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition)
-{
-	DHFS4_1_Bootsector bootSector;
-	uint64_t internalOffset = 0;
-
-	XWF_ShouldStop();
-
-	currentPosition = partition.bootSectorOffset * 512ULL + partition.partitionOffset * 512ULL;
-	std::unique_ptr<BYTE[]> buffer = reader.readSectors(currentPosition, 1);
-
-	internalOffset += 16;
-
-	memcpy(&bootSector.beginTime, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&bootSector.endTime, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	internalOffset += 20;
-
-	memcpy(&bootSector.sectorSize, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&bootSector.clusterSize, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	internalOffset += 16;
-
-	memcpy(&bootSector.descriptorTableOffset, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&bootSector.dataAreaOffset, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
 
-	memcpy(&bootSector.descriptorTableItemcount, buffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	internalOffset += 168;
-
-	memcpy(&bootSector.logsOffset, buffer.get() + internalOffset, 4);
-
-	partition.bootsector = bootSector;
+	const wchar_t* itemName = XWF_GetItemName(itemId);
+	return itemName != nullptr && name == itemName && XWF_GetItemParent(itemId) == parentId;
 }
 
-BOOL readDescriptorTable(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor)
+// The checkpoint only knows the image, not the evidence object. Another evidence object of the same image
+// or a checkpoint in the temp directory without a case would resume with item ids of another volume snapshot.
+static BOOL hasCheckpointItems(DHFS4_1_Checkpoint& checkpoint, const std::vector<DHFS4_1_Partition>& partitionTable)
 {
-	XWF_ShouldStop();
-
-	std::vector<DHFS4_1_VideoFragment> videoFragments;
-
-	uint64_t sector = (descriptorId * 32ULL) / 512;
-
-	currentPosition = partition.partitionOffset * 512ULL + partition.bootsector.descriptorTableOffset * 512ULL + sector * 512ULL;
-
-	uint64_t internalOffset = (descriptorId * 32) % 512ULL;
-
-	std::unique_ptr<BYTE[]> sectorBuffer = reader.readSectors((currentPosition), 1);
-
-	uint8_t id;
-	uint8_t camera;
-	uint16_t fragmentCount;
-	uint32_t begin;
-	uint32_t end;
-	uint32_t nextDescriptorId;
-	uint16_t lastFragmentSize;
-	uint32_t prevDescriptorId;
-	uint32_t mainDescriptorId; // Main-Descriptor position in descriptor table
-
-	XWF_ShouldStop();
-
-	memcpy(&id, sectorBuffer.get() + internalOffset, 1);
-	internalOffset += 1;
-
-	memcpy(&camera, sectorBuffer.get() + internalOffset, 1);
-	internalOffset += 1;
-
-	memcpy(&fragmentCount, sectorBuffer.get() + internalOffset, 2);
-	internalOffset += 2;
-
-	memcpy(&begin, sectorBuffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&end, sectorBuffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&nextDescriptorId, sectorBuffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&lastFragmentSize, sectorBuffer.get() + internalOffset, 2);
-	internalOffset += 2;
-
-	// Skip 2 unknown bytes
-	internalOffset += 2;
-
-	memcpy(&prevDescriptorId, sectorBuffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	memcpy(&mainDescriptorId, sectorBuffer.get() + internalOffset, 4);
-	internalOffset += 4;
-
-	internalOffset += 4;
-
-	if (id == 0xFE)
-	{
-		partition.freeDescriptors.push_back(descriptorId);
-	}
-	else if (id == 0x02)
-	{
-		partition.allocatedDescriptors.push_back(descriptorId);
-	}
-	else if (id == 0x01)
+	for (const DHFS4_1_Partition& partition : partitionTable)
 	{
-		if (begin < end)
+		const DHFS4_1_PartitionCheckpoint& state = checkpoint.getPartition(partition.id);
+
+		if (state.rootId == -1)
 		{
-			partition.allocatedDescriptors.push_back(descriptorId);
-			partition.cameras.insert(camera);
-
-			descriptor.beginDate = begin;
-			descriptor.endDate = end;
-			descriptor.fragmentCount = fragmentCount;
-			descriptor.lastFragmentSize = lastFragmentSize;
-			descriptor.id = descriptorId;
-			descriptor.camera = (camera & 0x0F) + 1;
-			descriptor.status = DHF4_1_DescriptorStatus::used;
-
-			DHFS4_1_VideoFragment videoFragment;
-			videoFragment.beginDate = begin;
-			videoFragment.endDate = end;
-			videoFragment.fragmentId = fragmentCount; // When id == 0x02 fragmentCount is the fragment id
-			videoFragment.id = descriptorId;
-			videoFragment.fragmentSize = partition.bootsector.clusterSize;
-			videoFragment.nextFragmentId = nextDescriptorId;
-			videoFragment.prevFragmentId = 0;
-			videoFragment.mainDescriptorId = descriptorId;
-			videoFragments.push_back(videoFragment);
-
-			uint32_t nextFragmentId = videoFragment.nextFragmentId;
-
-			while (nextFragmentId != 0)
+			// The folders are created before anything else, so a partition without one hasn't started
+			if (state.phase != DHFS4_1_ScanPhase::descriptors || state.nextDescriptor > 0)
 			{
-				uint8_t id;
-				uint8_t camera;
-				uint16_t fragmentCount;
-				uint32_t begin;
-				uint32_t end;
-				uint32_t nextDescriptorId;
-				uint32_t lastFragmentSize;
-				uint32_t prevDescriptorId;
-				uint32_t mainDescriptorId;
-
-				uint64_t sector = (nextFragmentId * 32ULL) / 512;
-
-				currentPosition = partition.partitionOffset * 512ULL + partition.bootsector.descriptorTableOffset * 512ULL + sector * 512ULL;
-
-				uint64_t internalOffset = (nextFragmentId * 32) % 512ULL;
-
-				std::unique_ptr<BYTE[]> sectorBuffer = reader.readSectors(currentPosition, 1);
-
-				memcpy(&id, sectorBuffer.get() + internalOffset, 1);
-				internalOffset += 1;
-
-				memcpy(&camera, sectorBuffer.get() + internalOffset, 1);
-				internalOffset += 1;
-
-				memcpy(&fragmentCount, sectorBuffer.get() + internalOffset, 2);
-				internalOffset += 2;
-
-				memcpy(&begin, sectorBuffer.get() + internalOffset, 4);
-				internalOffset += 4;
-
-				memcpy(&end, sectorBuffer.get() + internalOffset, 4);
-				internalOffset += 4;
-
-				memcpy(&nextDescriptorId, sectorBuffer.get() + internalOffset, 4);
-				internalOffset += 4;
-
-				memcpy(&lastFragmentSize, sectorBuffer.get() + internalOffset, 4);
-				internalOffset += 4;
-
-				memcpy(&prevDescriptorId, sectorBuffer.get() + internalOffset, 4);
-				internalOffset += 4;
-
-				memcpy(&mainDescriptorId, sectorBuffer.get() + internalOffset, 4);
-				internalOffset += 4;
-
-				internalOffset += 4;
-
-				DHFS4_1_VideoFragment videoFragment;
-				videoFragment.beginDate = begin;
-				videoFragment.endDate = end;
-				videoFragment.fragmentId = fragmentCount; // When id == 0x02 fragmentCount is the fragment id
-				videoFragment.id = nextFragmentId;
-				videoFragment.nextFragmentId = nextDescriptorId;
-				videoFragment.prevFragmentId = prevDescriptorId;
-				videoFragment.mainDescriptorId = mainDescriptorId;
-
-				if (videoFragment.nextFragmentId == 0)
-				{
-					videoFragment.fragmentSize = descriptor.lastFragmentSize;
-
-					std::pair<uint64_t, uint64_t> lastFragment;
-					partition.lastFragmentDescriptors.push_back({ nextFragmentId, descriptor.lastFragmentSize });
-
-				}
-				else
-				{
-					videoFragment.fragmentSize = partition.bootsector.clusterSize;
-				}
-
-				videoFragments.push_back(videoFragment);
-
-				nextFragmentId = videoFragment.nextFragmentId;
+				return false;
 			}
+			continue;
+		}
 
-			descriptor.videoFragments = videoFragments;
-			return true;
+		if (!isOwnItem(state.rootId, std::format(L"Partition {}", partition.id), 0))
+		{
+			return false;
+		}
+
+		if (state.carvedRootId != -1 && !isOwnItem(state.carvedRootId, L"Carved", state.rootId))
+		{
+			return false;
 		}
 	}
-	return false;
+	return true;
 }
 
-void carveFreeDescriptor(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition)
+LONG XT_ProcessItemEx(LONG nItemID, HANDLE hItem, PVOID lpReserved)
 {
-	XWF_ShouldStop();
+	XWF_OutputMessage(L"Starting DHFS4.1 Filetree X-Tension", 0);
+	resetStop();
 
-	std::wstring progressDescription = std::format(L"Carve descriptor table of partition {}", partition.id);
+	std::vector<DHFS4_1_Partition> partitionTable;
+	DHFS4_1_ItemReader reader;	
+	reader.setHandle(hItem);
 
-	BYTE dhavSignaturBegin[4] = { 0x44, 0x48, 0x41, 0x56 };
-	BYTE dhavSignaturEnd[4] = { 0x64, 0x68, 0x61, 0x76 };
-	int i = 0;
+	uint32_t dhfsId;
 
-	uint32_t bitmask = ~((1U << 12) - 1);
+	DHFS4_1_Buffer buffer = reader.readSectors(0, 1);
 
-	std::unordered_map<uint8_t, std::unordered_map<uint32_t, std::vector<DHFS4_1_Videoframe>>> carvedFramgentsMap; // [camera][hourly timestamp][list of fragments]
-	std::vector<DHFS4_1_Videoframe> carvedVideoFrames;
-	
-	XWF_ShowProgress((wchar_t*)progressDescription.c_str(), (0x04 | 0x08));
-	XWF_SetProgressPercentage(0);
+	memcpy(&dhfsId, buffer.get(), 4);
 
-	for (uint32_t& descriptorId : partition.freeDescriptors)
+	if (dhfsId == 0x53464844)
 	{
-		XWF_ShouldStop();
-		currentPosition = (partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL;
-		std::unique_ptr<BYTE[]> descriptorBuffer = reader.readSectors(currentPosition, partition.bootsector.clusterSize);
+		readPartitionTable(reader, partitionTable);
 
-		for (uint64_t j = 0; j <= (4096 * 512) - 4;)
+		for (DHFS4_1_Partition& partition : partitionTable)
 		{
-			if (std::memcmp(descriptorBuffer.get() + j, dhavSignaturBegin, 4) == 0)
-			{
-				uint16_t camera = 0;
-				uint32_t length = 0;
-				uint32_t dhfsTimestamp = 0;
-
-				memcpy(&camera, descriptorBuffer.get() + j + 6, 2);
-				memcpy(&length, descriptorBuffer.get() + j + 12, 4);
-				memcpy(&dhfsTimestamp, descriptorBuffer.get() + j + 16, 4);
-
-				// probably no real DHAV frame, so skip this
-				if (length == 0 || dhfsTimestamp == 0)
-				{
-					j++;
-					continue;
-				}
-
-				if (!validateDHFSTime(dhfsTimestamp))
-				{
-					j++;
-					continue;
-				}
+			readBootSector(reader, partition);
+		}
 
-				DHFS4_1_Videoframe carvedVideoFrame;
-				carvedVideoFrame.beginDate = dhfsTimestamp;
-				carvedVideoFrame.length = length;
-				carvedVideoFrame.mainDescriptorId = descriptorId;
-				carvedVideoFrame.status = DHF4_1_DescriptorStatus::carved;
-				carvedVideoFrame.camera = camera;
-				carvedVideoFrame.bytesDue = 0;
-				carvedVideoFrame.videoOffset = j;
-
-				// Videoframe is within cluster, so no internal fragmentation
-				if (length + j < 4096 * 512)
-				{
-					
-					uint32_t length = 0;
-					uint32_t endSig = 0;
+		DHFS4_1_ImageIdentity identity;
+		identity.imageSize = XWF_GetSize(hItem, NULL);
+		identity.bootHash = hashBootSectors(reader, partitionTable);
 
-					memcpy(&length, descriptorBuffer.get() + j + carvedVideoFrame.length - 4, 4);
+		DHFS4_1_IndexWriter indexWriter;
 
-					// Matching footer in fragment
-					if (length == carvedVideoFrame.length && std::memcmp(descriptorBuffer.get() + j + carvedVideoFrame.length - 8, dhavSignaturEnd, 4) == 0)
-					{
-						j = j + length;
-					}
-					// No matching footer, so probably no real frame
-					else
-					{
-						j++;
-						continue;
-					}
-
-					// If the matching footer isn't necessary comment above code out
-					// j = j + length
-				}
-				else
-				{
-					carvedVideoFrame.status = DHF4_1_DescriptorStatus::fragCarved;
-					carvedVideoFrame.bytesDue = (-1) * ((4096 * 512 - j) - (length));
-					carvedVideoFrames.push_back(carvedVideoFrame);
-					break;
-				}
-				carvedVideoFrames.push_back(carvedVideoFrame);
-			}
-			else if (std::memcmp(descriptorBuffer.get() + j, dhavSignaturEnd, 4) == 0)
+		// Continue an interrupted run, everything before its checkpoint is only read again, not created again
+		DHFS4_1_Checkpoint checkpoint;
+		if (checkpoint.open(getCheckpointPath(identity), identity))
+		{
+			if (hasCheckpointItems(checkpoint, partitionTable))
 			{
-				uint32_t length = 0;
-				memcpy(&length, descriptorBuffer.get() + j + 4, 4);
-
-				// again, probably no real dhav footer
-				if (length == 0)
-				{
-					j++;
-					continue;
-				}
-
-				// 4 bytes dhav, 4 bytes length
-				j += 8;
-
-				for (int i = carvedVideoFrames.size()-1; i >= 0; i--)
-				{
-					// lookout for a DHAV head which
-					// 1. got the same length as the footer
-					// 2. is fragmented due to the cluster size
-					// 3. the pending bytes are the same as the offset to the dhav ending
-					if (carvedVideoFrames[i].length == length &&
-						carvedVideoFrames[i].status == DHF4_1_DescriptorStatus::fragCarved &&
-						carvedVideoFrames[i].bytesDue == j)
-					{
-
-						DHFS4_1_Videoframe carvedVideoTail;
-						carvedVideoTail.beginDate = carvedVideoFrames[i].beginDate;
-						carvedVideoTail.length = j;
-						carvedVideoTail.mainDescriptorId = descriptorId;
-						carvedVideoTail.status = DHF4_1_DescriptorStatus::carved;
-						carvedVideoTail.camera = (carvedVideoFrames[i].camera & 0x0F) + 1;
-						carvedVideoTail.bytesDue = 0;
-						carvedVideoTail.videoOffset = 0;
-
-						carvedVideoFrames[i].status = DHF4_1_DescriptorStatus::carved;
-
-						carvedVideoFrames.push_back(carvedVideoTail);
-					}
-				}				
+				XWF_OutputMessage(L"Resuming the DHFS4.1 scan from the last checkpoint", 0);
 			}
 			else
 			{
-				j++;
+				checkpoint.reset();
+				XWF_OutputMessage(L"The DHFS4.1 checkpoint belongs to another volume snapshot, scanning from the start", 0);
 			}
 		}
-		i++;
-		XWF_SetProgressPercentage(DWORD((100. / partition.freeDescriptors.size()) * i));
-	}
-		
-	// Sort all carved fragments and map them to the cameras and duration
-	for (DHFS4_1_Videoframe & carvedVideoFrame : carvedVideoFrames)
-	{
-		carvedFramgentsMap[carvedVideoFrame.camera][(carvedVideoFrame.beginDate & bitmask)].push_back(carvedVideoFrame);
-	}
 
-	// Create new descriptors which can be used for the VS items
-	std::vector<DHFS4_1_Descriptor> videoDescriptors;
-	int index = 0;
-	for (auto& channelMap : carvedFramgentsMap)
-	{
-		for (auto& timeMap : channelMap.second)
+		// Folders are created up front, so the tree keeps the partition order while they run concurrently
+		for (DHFS4_1_Partition& partition : partitionTable)
 		{
-			// the duration is not exactly 1 hour, but now the fragments can assign to a time range...
-			DHFS4_1_Descriptor descriptor;
-			descriptor.beginDate = timeMap.first;
-			descriptor.endDate = (timeMap.first + 4096) & bitmask;
-			descriptor.camera = channelMap.first;
-			descriptor.id = index;
-
-			uint64_t offsetInStream = 0;
+			DHFS4_1_PartitionCheckpoint& state = checkpoint.getPartition(partition.id);
+			indexWriter.addPartition(partition);
 
-			for (int i = 0; i < timeMap.second.size(); i++)
+			if (state.rootId == -1)
 			{
-				DHFS4_1_VideoFragment videoFragment;
-				videoFragment.beginDate = timeMap.second[i].beginDate;
-				videoFragment.endDate = (timeMap.second[i].beginDate + 4096) & bitmask;
-				videoFragment.offset = timeMap.second[i].videoOffset;
-				videoFragment.mainDescriptorId = timeMap.second[i].mainDescriptorId;
-				videoFragment.id = timeMap.second[i].mainDescriptorId;
-				videoFragment.endDate = (timeMap.second[i].beginDate + 4096) & bitmask;
-				videoFragment.nextFragmentId = i < timeMap.second.size() - 1 ? timeMap.second[i + 1].mainDescriptorId : 0;
-				videoFragment.prevFragmentId = i > 0 ? timeMap.second[i - 1].mainDescriptorId : 0;
-				videoFragment.fragmentSize = timeMap.second[i].length - timeMap.second[i].bytesDue; // to get the size in this fragment, not the total size
-				videoFragment.offsetInStream = offsetInStream;
-
-				offsetInStream += videoFragment.fragmentSize;
-
-				descriptor.videoFragments.push_back(videoFragment);
+				std::wstring folderName = std::format(L"Partition {}", partition.id);
+				state.rootId = XWF_CreateItem(const_cast<LPWSTR>(folderName.c_str()), 0x00000001);
+				XWF_SetItemInformation(state.rootId, XWF_ITEM_INFO_FLAGS, 0x00000001);
+				XWF_SetItemParent(state.rootId, 0);
 			}
-
-			partition.carvedDescriptors.push_back(descriptor);
-			index++;
+			partition.rootId = state.rootId;
 		}
-	}
-
-	XWF_HideProgress();
-}
-
-void carveSlackSpace(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition)
-{
-	XWF_ShouldStop();
-
-	std::wstring progressDescription = std::format(L"Carve slack space of partition {}", partition.id);
-
-	BYTE dhavSignaturBegin[4] = { 0x44, 0x48, 0x41, 0x56 };
-	BYTE dhavSignaturEnd[4] = { 0x64, 0x68, 0x61, 0x76 };
-	int i = 0;
-
-	uint32_t bitmask = ~((1U << 12) - 1);
 
-	std::unordered_map<uint8_t, std::unordered_map<uint32_t, std::vector<DHFS4_1_Videoframe>>> carvedFramgentsMap; // [camera][hourly timestamp][list of fragments]
-	std::vector<DHFS4_1_Videoframe> carvedVideoFrames;
+		std::atomic<BOOL> stopped = false;
+		std::vector<std::function<void()>> workers;
 
-	XWF_ShowProgress((wchar_t*)progressDescription.c_str(), (0x04 | 0x08));
-	XWF_SetProgressPercentage(0);
-	i = 0;
-
-	for (const auto& lastFragment : partition.lastFragmentDescriptors)
-	{
-		XWF_ShouldStop();
-		uint64_t descriptorId = lastFragment.first;
-		uint64_t size = lastFragment.second;
-
-		currentPosition = (partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL;
-		std::unique_ptr<BYTE[]> descriptorBuffer = reader.readSectors(currentPosition, partition.bootsector.clusterSize);
-
-		for (uint64_t j = (size * 512); j <= (4096 * 512) - 4;)
+		for (DHFS4_1_Partition& partition : partitionTable)
 		{
-			XWF_ShouldStop();
-			if (std::memcmp(descriptorBuffer.get() + j, dhavSignaturBegin, 4) == 0)
-			{
-				uint16_t camera = 0;
-				uint32_t length = 0;
-				uint32_t dhfsTimestamp = 0;
-
-				memcpy(&camera, descriptorBuffer.get() + j + 6, 2);
-				memcpy(&length, descriptorBuffer.get() + j + 12, 4);
-				memcpy(&dhfsTimestamp, descriptorBuffer.get() + j + 16, 4);
-
-				// probably no real DHAV frame, so skip this
-				if (length == 0 || dhfsTimestamp == 0)
-				{
-					j++;
-					continue;
-				}
-
-				if (!validateDHFSTime(dhfsTimestamp))
-				{
-					j++;
-					continue;
-				}
-
-				DHFS4_1_Videoframe carvedVideoFrame;
-				carvedVideoFrame.beginDate = dhfsTimestamp;
-				carvedVideoFrame.length = length;
-				carvedVideoFrame.mainDescriptorId = descriptorId;
-				carvedVideoFrame.status = DHF4_1_DescriptorStatus::carved;
-				carvedVideoFrame.camera = camera;
-				carvedVideoFrame.bytesDue = 0;
-				carvedVideoFrame.videoOffset = j;
-
-				// Videoframe is within cluster, so no internal fragmentation
-				if (length + j < (4096 * 512))
-				{
-					uint32_t length = 0;
-					uint32_t endSig = 0;
-
-					memcpy(&length, descriptorBuffer.get() + j + carvedVideoFrame.length - 4, 4);
-
-					// Matching footer in fragment
-					if (length == carvedVideoFrame.length && std::memcmp(descriptorBuffer.get() + j + carvedVideoFrame.length - 8, dhavSignaturEnd, 4) == 0)
-					{
-						j = j + length;
-					}
-					// No matching footer, so probably no real frame
-					else
-					{
-						j++;
-						continue;
-					}
-
-					// If the matching footer isn't necessary comment above code out
-					// j = j + length
-				}
-				else
+			workers.push_back([&reader, &partition, &checkpoint, &indexWriter, &stopped]
 				{
-					carvedVideoFrame.status = DHF4_1_DescriptorStatus::fragCarved;
-					carvedVideoFrame.bytesDue = (-1) * ((4096 * 512 - j) - (length));
-					carvedVideoFrames.push_back(carvedVideoFrame);
-					break;
-				}
-				carvedVideoFrames.push_back(carvedVideoFrame);
-			}
-			else if (std::memcmp(descriptorBuffer.get() + j, dhavSignaturEnd, 4) == 0)
-			{
-				uint32_t length = 0;
-				memcpy(&length, descriptorBuffer.get() + j + 4, 4);
-
-				// again, probably no real dhav footer
-				if (length == 0)
-				{
-					j++;
-					continue;
-				}
-
-				// 4 bytes dhav, 4 bytes length
-				j += 8;
-
-				for (int i = carvedVideoFrames.size() - 1; i >= 0; i--)
-				{
-					// lookout for a DHAV head which
-					// 1. got the same length as the footer
-					// 2. is fragmented due to the cluster size
-					// 3. the pending bytes are the same as the offset to the dhav ending
-					if (carvedVideoFrames[i].length == length &&
-						carvedVideoFrames[i].status == DHF4_1_DescriptorStatus::fragCarved &&
-						carvedVideoFrames[i].bytesDue == j)
+					if (!processPartition(reader, partition, checkpoint, indexWriter))
 					{
-
-						DHFS4_1_Videoframe carvedVideoTail;
-						carvedVideoTail.beginDate = carvedVideoFrames[i].beginDate;
-						carvedVideoTail.length = j;
-						carvedVideoTail.mainDescriptorId = descriptorId;
-						carvedVideoTail.status = DHF4_1_DescriptorStatus::carved;
-						carvedVideoTail.camera = (carvedVideoFrames[i].camera & 0x0F) + 1;
-						carvedVideoTail.bytesDue = 0;
-						carvedVideoTail.videoOffset = 0;
-
-						carvedVideoFrames[i].status = DHF4_1_DescriptorStatus::carved;
-						carvedVideoFrames.push_back(carvedVideoTail);
+						stopped = true;
 					}
-				}
-			}
-			else
-			{
-				j++;
-			}
+				});
 		}
-		i++;
-		XWF_SetProgressPercentage(DWORD((100. / partition.lastFragmentDescriptors.size()) * i));
-	}
 
-	// Sort all carved fragments and map them to the cameras and duration
-	for (DHFS4_1_Videoframe& carvedVideoFrame : carvedVideoFrames)
-	{
-		carvedFramgentsMap[carvedVideoFrame.camera][(carvedVideoFrame.beginDate & bitmask)].push_back(carvedVideoFrame);
-	}
+		DHFS4_1_Dispatcher dispatcher;
+		dispatcher.run(std::format(L"Build file tree of {} partitions", partitionTable.size()), workers, getCarveSettings().threadCount);
 
-	// Create new descriptors which can be used for the VS items
-	std::vector<DHFS4_1_Descriptor> videoDescriptors;
-	int index = 0;
-	for (auto& channelMap : carvedFramgentsMap)
-	{
-		for (auto& timeMap : channelMap.second)
+		// Written for the Disk I/O mode, so XT_SectorIOInit doesn't need to scan again
+		std::vector<std::wstring> indexPaths = getIndexPaths(identity);
+		if (stopped)
 		{
-			// the duration is not exactly 1 hour, but now the fragments can assign to a time range...
-			DHFS4_1_Descriptor descriptor;
-			descriptor.beginDate = timeMap.first;
-			descriptor.endDate = (timeMap.first + 4096) & bitmask;
-			descriptor.camera = channelMap.first;
-			descriptor.id = index;
-
-			uint64_t offsetInStream = 0;
-
-			for (int i = 0; i < timeMap.second.size(); i++)
-			{
-				DHFS4_1_VideoFragment videoFragment;
-				videoFragment.beginDate = timeMap.second[i].beginDate;
-				videoFragment.endDate = (timeMap.second[i].beginDate + 4096) & bitmask;
-				videoFragment.offset = timeMap.second[i].videoOffset;
-				videoFragment.mainDescriptorId = timeMap.second[i].mainDescriptorId;
-				videoFragment.id = timeMap.second[i].mainDescriptorId;
-				videoFragment.endDate = (timeMap.second[i].beginDate + 4096) & bitmask;
-				videoFragment.nextFragmentId = i < timeMap.second.size() - 1 ? timeMap.second[i + 1].mainDescriptorId : 0;
-				videoFragment.prevFragmentId = i > 0 ? timeMap.second[i - 1].mainDescriptorId : 0;
-				videoFragment.fragmentSize = timeMap.second[i].length - timeMap.second[i].bytesDue; // to get the size in this fragment, not the total size
-				videoFragment.offsetInStream = offsetInStream;
-
-				offsetInStream += videoFragment.fragmentSize;
-
-				descriptor.videoFragments.push_back(videoFragment);
-			}
-
-			partition.carvedDescriptors.push_back(descriptor);
-			index++;
+			// An incomplete index would hide the missing files in the Disk I/O mode
+			checkpoint.save(true);
+			XWF_OutputMessage(L"DHFS4.1 scan stopped, no index written. Run the X-Tension again to continue from the checkpoint", 0);
+		}
+		else if (!indexPaths.empty() && indexWriter.write(indexPaths.front(), identity))
+		{
+			checkpoint.remove();
+			XWF_OutputMessage(std::format(L"DHFS4.1 index written to {}", indexPaths.front()).c_str(), 0);
+		}
+		else
+		{
+			XWF_OutputMessage(L"Couldn't write the DHFS4.1 index, Disk I/O mode will scan the whole disk", 0);
 		}
 	}
+	else
+	{
+		XWF_OutputMessage(L"Wrong Dahua signature!", 0);
+	}
 
-	XWF_HideProgress();
-}
-
-
-DHFS4_1_Time convertDfhstime(uint32_t dhfsTimestamp)
-{
-	DHFS4_1_Time dhfsTime;
-	dhfsTime.year = (dhfsTimestamp >> (31 + 1 - 6)) & ((1u << 6) - 1); // 6 bits year
-	dhfsTime.month = (dhfsTimestamp >> (25 + 1 - 4)) & ((1u << 4) - 1); // 4 bits month
-	dhfsTime.day = (dhfsTimestamp >> (21 + 1 - 5)) & ((1u << 5) - 1); // 5 bits day
-	dhfsTime.hour = (dhfsTimestamp >> (16 + 1 - 5)) & ((1u << 5) - 1); // 5 bits hour
-	dhfsTime.minute = (dhfsTimestamp >> (11 + 1 - 6)) & ((1u << 6) - 1); // 6 bits minute
-	dhfsTime.second = (dhfsTimestamp >> (5 + 1 - 6)) & ((1u << 6) - 1); // 6 bits seconds
-
-	return dhfsTime;
+	return 0;
 }
 
-INT64 dhfstimeToFiletime(uint32_t dhfsTimestamp)
+DWORD createVSItems(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_Descriptor descriptor)
 {
-	DHFS4_1_Time dhfsTime = convertDfhstime(dhfsTimestamp);
+	const std::wstring itemType = std::wstring(L"dav\0");
 
-	std::tm t = {};
-	t.tm_year = dhfsTime.year - 1900 + 2000;
-	t.tm_mon = dhfsTime.month - 1;
-	t.tm_mday = dhfsTime.day;
-	t.tm_hour = dhfsTime.hour;
-	t.tm_min = dhfsTime.minute;
-	t.tm_sec = dhfsTime.second;
+	uint32_t descriptorId = descriptor.id;
+	uint32_t videoOffset = 0;
 
-	uint64_t unixtime = static_cast<INT64>(timegm(&t));
+	if (descriptor.status != DHF4_1_DescriptorStatus::carved)
+	{
+		videoOffset = getVideoOffset(reader, partition, descriptorId);
+	}
 	
-	const uint64_t EPOCH_DIFFERENCE = 116444736000000000ULL;
-	uint64_t fileTimeValue = unixtime * 10000000ULL + EPOCH_DIFFERENCE;
+	std::vector<DHFS4_1_VideoFragment> videoFragments = descriptor.videoFragments;
 
-	FILETIME ft;
-	ULARGE_INTEGER ull;
-	ft.dwLowDateTime = static_cast<DWORD>(fileTimeValue & 0xFFFFFFFF);
-	ft.dwHighDateTime = static_cast<DWORD>(fileTimeValue >> 32);
+	uint64_t totalFragmentSize = 0;
+	for (const DHFS4_1_VideoFragment& videoFragment : videoFragments)
+	{
+		totalFragmentSize += videoFragment.fragmentSize;
+	}
 
-	ull.LowPart = ft.dwLowDateTime;
-	ull.HighPart = ft.dwHighDateTime;
+	uint64_t fileSize = (totalFragmentSize) * 512ULL - videoOffset;
 
-	INT64 ret = static_cast<INT64>(ull.QuadPart);
+	wchar_t fileName[DHFS4_1_VIDEO_NAME_LENGTH];
+	int childId = XWF_CreateItem(const_cast<LPWSTR>(formatVideoName(descriptor.camera, descriptor.beginDate, descriptor.endDate, fileName)), 0x00000001);
+	XWF_SetItemInformation(childId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(descriptor.beginDate));
+	XWF_SetItemInformation(childId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(descriptor.endDate));
+	XWF_SetItemSize(childId, fileSize);
+	XWF_SetItemType(childId, const_cast <LPWSTR>(itemType.c_str()), 3);
+	std::wstring metaData = std::to_wstring(partition.id) + L":" + std::to_wstring(descriptorId);
+	XWF_AddExtractedMetadata(childId, &metaData[0], 0x01);
+	XWF_SetItemParent(childId, partition.rootId);
+
+	XWF_SetItemOfs(childId, (-1) * ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL + videoOffset), ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) + videoOffset / 512));
 
-	return ret;
+	return 0;
 }
 
-BOOL validateDHFSTime(uint32_t dhfsTimestamp)
+DWORD createVSCarvedItems(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_Descriptor descriptor, size_t index)
 {
-	DHFS4_1_Time dhfsTime = convertDfhstime(dhfsTimestamp);
-
-	// filter dates that make no sense
-	if (dhfsTime.year < 1 ||
-		dhfsTime.month < 1 ||
-		dhfsTime.month > 12 ||
-		dhfsTime.day < 1 ||
-		dhfsTime.day > 31 ||
-		dhfsTime.hour < 0 ||
-		dhfsTime.hour > 23 ||
-		dhfsTime.minute < 0 ||
-		dhfsTime.minute > 59 ||
-		dhfsTime.second < 0 ||
-		dhfsTime.second > 59)
-	{
-		return false;
-	}
+	const std::wstring itemType = std::wstring(L"dav\0");
+
+	uint32_t descriptorId = descriptor.id;
 
+	std::vector<DHFS4_1_VideoFragment> videoFragments = descriptor.videoFragments;
 
-	std::tm t = {};
-	t.tm_year = dhfsTime.year - 1900 + 2000;
-	t.tm_mon = dhfsTime.month - 1;
-	t.tm_mday = dhfsTime.day;
-	t.tm_hour = dhfsTime.hour;
-	t.tm_min = dhfsTime.minute;
-	t.tm_sec = dhfsTime.second;
+	uint64_t totalFragmentSize = 0;
 
-	std::time_t time = std::mktime(&t);
-	if (time == -1)
+	if (videoFragments.size() == 0)
 	{
-		return false;
+		return 0;
 	}
-	
-	std::tm norm = {};
-	if (localtime_s(&norm, &time) != 0)
+
+	for (const DHFS4_1_VideoFragment& videoFragment : videoFragments)
 	{
-		return false;
+		totalFragmentSize += videoFragment.fragmentSize;
 	}
 
-	return (norm.tm_year == t.tm_year &&
-		norm.tm_mon == t.tm_mon &&
-		norm.tm_mday == t.tm_mday &&
-		norm.tm_hour == t.tm_hour &&
-		norm.tm_min == t.tm_min &&
-		norm.tm_sec == t.tm_sec);
+	uint64_t fileSize = totalFragmentSize;
+
+	wchar_t fileName[DHFS4_1_VIDEO_NAME_LENGTH];
+	int childId = XWF_CreateItem(const_cast<LPWSTR>(formatVideoName(descriptor.camera, descriptor.beginDate, descriptor.endDate, fileName)), 0x00000001);
+	XWF_SetItemInformation(childId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(descriptor.beginDate));
+	XWF_SetItemInformation(childId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(descriptor.endDate));
+	XWF_SetItemSize(childId, fileSize);
+	XWF_SetItemType(childId, const_cast <LPWSTR>(itemType.c_str()), 3);
+	std::wstring metaData = std::to_wstring(partition.id) + L":" + L"Carved:" + std::to_wstring(index);
+	XWF_AddExtractedMetadata(childId, &metaData[0], 0x01);
+	XWF_SetItemParent(childId, partition.carvedRootId);
+
+	XWF_SetItemOfs(childId, (-1) * ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) * 512ULL + videoFragments[0].offset), ((partition.partitionOffset + partition.bootsector.dataAreaOffset + partition.bootsector.clusterSize * descriptorId) + videoFragments[0].offset / 512));
+
+	return 0;
 }
 
-std::wstring dhfstimeToWString(uint32_t dhfsTimestamp)
+DWORD createVSLogfile(DHFS4_1_Partition partition)
 {
-	DHFS4_1_Time dhfsTime = convertDfhstime(dhfsTimestamp);
+	uint32_t logFileSize = 0;
+	const std::wstring logType = std::wstring(L"txt\0");
+
+	uint64_t logOffset = (partition.partitionOffset + partition.bootsector.logsOffset) * 512ULL;
+
+	DHFS4_1_Buffer logBuffer = reader.readSectors(logOffset, 1);
+	memcpy(&logFileSize, logBuffer.get(), 4);
 
-	return std::format(L"{:02d}.{:02d}.{}_{:02d}:{:02d}:{:02d}", dhfsTime.day, dhfsTime.month, (dhfsTime.year + 2000), dhfsTime.hour, dhfsTime.minute, dhfsTime.second);
+	std::wstring logFileName = std::format(L"Part_{}_Logfile.txt", partition.id);
+	int logFiledId = XWF_CreateItem(const_cast<LPWSTR>(logFileName.c_str()), 0x00000001);
+
+	if (logFiledId != -1)
+	{
+		XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_CREATIONTIME, dhfstimeToFiletime(partition.bootsector.beginTime));
+		XWF_SetItemInformation(logFiledId, XWF_ITEM_INFO_MODIFICATIONTIME, dhfstimeToFiletime(partition.bootsector.endTime));
+		XWF_SetItemSize(logFiledId, logFileSize);
+
+		XWF_SetItemType(logFiledId, const_cast <LPWSTR>(logType.c_str()), 3);
+		std::wstring metaData = std::to_wstring(partition.id) + L":" + L"Logfile";
+		XWF_AddExtractedMetadata(logFiledId, &metaData[0], 0x01);
+		XWF_SetItemParent(logFiledId, partition.rootId);
+		XWF_SetItemOfs(logFiledId, (-1) * ((partition.partitionOffset + partition.bootsector.logsOffset + 2) * 512ULL), ((partition.partitionOffset + partition.bootsector.logsOffset + 2)));
+		return 0;
+	}
+	return -1;
 }
@@ -0,0 +1,414 @@
+#include "pch.h"
+#include "dhfs4_1_asyncreader.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+uint32_t getQueueDepth()
+{
+	uint32_t queueDepth = DHFS4_1_QUEUE_DEPTH;
+
+	wchar_t value[16] = { 0 };
+	DWORD length = GetEnvironmentVariableW(L"DHFS4_1_QUEUE_DEPTH", value, 16);
+
+	if (length > 0 && length < 16)
+	{
+		queueDepth = wcstoul(value, nullptr, 10);
+	}
+
+	if (queueDepth == 0)
+	{
+		queueDepth = 1;
+	}
+	if (queueDepth > DHFS4_1_MAX_QUEUE_DEPTH)
+	{
+		queueDepth = DHFS4_1_MAX_QUEUE_DEPTH;
+	}
+
+	return queueDepth;
+}
+
+class DHFS4_1_ThreadPoolReader : public DHFS4_1_AsyncReader
+{
+private:
+	struct Completion {
+		uint64_t tag;
+		BOOL success;
+	};
+
+	std::function<BOOL(uint64_t, uint64_t, BYTE*)> read;
+	size_t queueDepth;
+	size_t alignment;
+	size_t inFlight = 0;
+	BOOL closing = false;
+	std::deque<std::pair<DHFS4_1_ReadRequest, uint64_t>> requests;
+	std::deque<Completion> completions;
+	std::mutex mutex;
+	std::condition_variable submitted;
+	std::condition_variable completed;
+	std::vector<std::thread> threads;
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		while (true)
+		{
+			this->submitted.wait(lock, [&] { return !this->requests.empty() || this->closing; });
+
+			if (this->requests.empty())
+			{
+				return;
+			}
+
+			std::pair<DHFS4_1_ReadRequest, uint64_t> request = this->requests.front();
+			this->requests.pop_front();
+			lock.unlock();
+
+			const DHFS4_1_ReadRequest& read = request.first;
+			BOOL success = this->read(read.offset, read.length, read.destination);
+
+			lock.lock();
+			this->completions.push_back({ request.second, success });
+			this->completed.notify_one();
+		}
+	}
+
+public:
+	DHFS4_1_ThreadPoolReader(const std::function<BOOL(uint64_t, uint64_t, BYTE*)>& read, size_t queueDepth, size_t alignment) : read(read), queueDepth(queueDepth), alignment(alignment) {}
+
+	~DHFS4_1_ThreadPoolReader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->closing = true;
+		}
+		this->submitted.notify_all();
+
+		for (std::thread& thread : this->threads)
+		{
+			thread.join();
+		}
+	}
+
+	void submit(const DHFS4_1_ReadRequest& request, uint64_t tag)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		// Started when they are needed, a queue which never fills up doesn't cost threads
+		if (this->threads.size() < this->queueDepth && this->threads.size() <= this->inFlight)
+		{
+			this->threads.emplace_back([this] { run(); });
+		}
+
+		this->requests.push_back({ request, tag });
+		this->inFlight++;
+		this->submitted.notify_one();
+	}
+
+	BOOL wait(uint64_t& tag, BOOL& success)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		if (this->inFlight == 0)
+		{
+			return false;
+		}
+
+		this->completed.wait(lock, [&] { return !this->completions.empty(); });
+
+		tag = this->completions.front().tag;
+		success = this->completions.front().success;
+		this->completions.pop_front();
+		this->inFlight--;
+		return true;
+	}
+
+	size_t getInFlight() const
+	{
+		return this->inFlight;
+	}
+
+	size_t getQueueDepth() const
+	{
+		return this->queueDepth;
+	}
+
+	size_t getAlignment() const
+	{
+		return this->alignment;
+	}
+
+	const wchar_t* getName() const
+	{
+		return this->alignment > 1 ? L"threads, direct" : L"threads";
+	}
+};
+
+std::unique_ptr<DHFS4_1_AsyncReader> createThreadPoolReader(DHFS_4_1_ReaderInterface& reader, size_t queueDepth)
+{
+	return createThreadPoolReader([&reader](uint64_t offset, uint64_t length, BYTE* buffer)
+		{
+			// Not every reader zeroes what it couldn't read
+			BOOL success = reader.readBytesInto(offset, length, buffer);
+			if (!success)
+			{
+				ZeroMemory(buffer, length);
+			}
+			return success;
+		}, queueDepth, 1);
+}
+
+std::unique_ptr<DHFS4_1_AsyncReader> createThreadPoolReader(const std::function<BOOL(uint64_t, uint64_t, BYTE*)>& read, size_t queueDepth, size_t alignment)
+{
+	return std::make_unique<DHFS4_1_ThreadPoolReader>(read, max(queueDepth, size_t(1)), alignment);
+}
+
+#ifdef __linux__
+
+// Talks to the kernel directly instead of through liburing, the X-Tension has no dependencies either
+class DHFS4_1_UringReader : public DHFS4_1_AsyncReader
+{
+private:
+	struct Slot {
+		DHFS4_1_ReadRequest request;
+		uint64_t tag;
+	};
+
+	DHFS_4_1_ReaderInterface& reader;
+	int fd;
+	DHFS4_1_ReadCounters& counters;
+	int ringFd = -1;
+	size_t queueDepth;
+	size_t alignment;
+	size_t inFlight = 0;
+	uint32_t unsubmitted = 0; // prepared entries io_uring_enter didn't take yet
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+
+	void* sqRing = MAP_FAILED;
+	void* cqRing = MAP_FAILED;
+	size_t sqRingSize = 0;
+	size_t cqRingSize = 0;
+	io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+	size_t sqesSize = 0;
+
+	uint32_t* sqTail = nullptr;
+	uint32_t* sqMask = nullptr;
+	uint32_t* sqArray = nullptr;
+	uint32_t* cqHead = nullptr;
+	uint32_t* cqTail = nullptr;
+	uint32_t* cqMask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	static uint32_t* ringField(void* ring, uint32_t offset)
+	{
+		return reinterpret_cast<uint32_t*>(static_cast<BYTE*>(ring) + offset);
+	}
+
+	int enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+	{
+		this->counters.calls++;
+		return int(syscall(__NR_io_uring_enter, this->ringFd, toSubmit, minComplete, flags, nullptr, 0));
+	}
+
+public:
+	DHFS4_1_UringReader(DHFS_4_1_ReaderInterface& reader, int fd, DHFS4_1_ReadCounters& counters, size_t queueDepth, size_t alignment) : reader(reader), fd(fd), counters(counters), queueDepth(queueDepth), alignment(alignment) {}
+
+	~DHFS4_1_UringReader()
+	{
+		// The kernel must not write into buffers the consumer already freed
+		uint64_t tag;
+		BOOL success;
+		while (wait(tag, success))
+		{
+		}
+
+		if (this->sqes != MAP_FAILED)
+		{
+			munmap(this->sqes, this->sqesSize);
+		}
+		if (this->cqRing != MAP_FAILED && this->cqRing != this->sqRing)
+		{
+			munmap(this->cqRing, this->cqRingSize);
+		}
+		if (this->sqRing != MAP_FAILED)
+		{
+			munmap(this->sqRing, this->sqRingSize);
+		}
+		if (this->ringFd >= 0)
+		{
+			close(this->ringFd);
+		}
+	}
+
+	BOOL setup()
+	{
+		io_uring_params params = {};
+
+		this->ringFd = int(syscall(__NR_io_uring_setup, uint32_t(this->queueDepth), &params));
+		if (this->ringFd < 0)
+		{
+			return false;
+		}
+
+		this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		// Newer kernels put both rings into one mapping
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			this->sqRingSize = this->cqRingSize = max(this->sqRingSize, this->cqRingSize);
+		}
+
+		this->sqRing = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_SQ_RING);
+		if (this->sqRing == MAP_FAILED)
+		{
+			return false;
+		}
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			this->cqRing = this->sqRing;
+		}
+		else
+		{
+			this->cqRing = mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_CQ_RING);
+			if (this->cqRing == MAP_FAILED)
+			{
+				return false;
+			}
+		}
+
+		this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		this->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_SQES));
+		if (this->sqes == MAP_FAILED)
+		{
+			return false;
+		}
+
+		this->sqTail = ringField(this->sqRing, params.sq_off.tail);
+		this->sqMask = ringField(this->sqRing, params.sq_off.ring_mask);
+		this->sqArray = ringField(this->sqRing, params.sq_off.array);
+		this->cqHead = ringField(this->cqRing, params.cq_off.head);
+		this->cqTail = ringField(this->cqRing, params.cq_off.tail);
+		this->cqMask = ringField(this->cqRing, params.cq_off.ring_mask);
+		this->cqes = reinterpret_cast<io_uring_cqe*>(static_cast<BYTE*>(this->cqRing) + params.cq_off.cqes);
+
+		this->slots.resize(this->queueDepth);
+		for (uint32_t i = 0; i < this->queueDepth; i++)
+		{
+			this->freeSlots.push_back(uint32_t(this->queueDepth - 1 - i));
+		}
+		return true;
+	}
+
+	void submit(const DHFS4_1_ReadRequest& request, uint64_t tag)
+	{
+		uint32_t slot = this->freeSlots.back();
+		this->freeSlots.pop_back();
+		this->slots[slot] = { request, tag };
+
+		// Only this thread writes the submission queue, the kernel reads it once io_uring_enter is called
+		uint32_t tail = __atomic_load_n(this->sqTail, __ATOMIC_RELAXED);
+		uint32_t index = tail & *this->sqMask;
+
+		io_uring_sqe* sqe = &this->sqes[index];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = this->fd;
+		sqe->off = request.offset;
+		sqe->addr = reinterpret_cast<uint64_t>(request.destination);
+		sqe->len = uint32_t(request.length);
+		sqe->user_data = slot;
+
+		this->sqArray[index] = index;
+		__atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+		this->unsubmitted++;
+		this->inFlight++;
+	}
+
+	BOOL wait(uint64_t& tag, BOOL& success)
+	{
+		if (this->inFlight == 0)
+		{
+			return false;
+		}
+
+		uint32_t head = __atomic_load_n(this->cqHead, __ATOMIC_RELAXED);
+
+		// The prepared reads go to the kernel together with the wait, one system call for both
+		while (head == __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE))
+		{
+			int submitted = enter(this->unsubmitted, 1, IORING_ENTER_GETEVENTS);
+			if (submitted > 0)
+			{
+				this->unsubmitted -= min(uint32_t(submitted), this->unsubmitted);
+			}
+		}
+
+		const io_uring_cqe& cqe = this->cqes[head & *this->cqMask];
+		int32_t result = cqe.res;
+		uint32_t slot = uint32_t(cqe.user_data);
+		__atomic_store_n(this->cqHead, head + 1, __ATOMIC_RELEASE);
+
+		const DHFS4_1_ReadRequest& request = this->slots[slot].request;
+		uint64_t done = result > 0 ? uint64_t(result) : 0;
+		this->counters.bytes += done;
+
+		// Short reads and errors (including kernels without IORING_OP_READ) are finished synchronously.
+		// That's a cached read even for a direct ring, it only happens at the end of the image.
+		// readBytesInto of the file reader zeroes what it couldn't read
+		success = done == request.length || this->reader.readBytesInto(request.offset + done, request.length - done, request.destination + done);
+
+		tag = this->slots[slot].tag;
+		this->freeSlots.push_back(slot);
+		this->inFlight--;
+		return true;
+	}
+
+	size_t getInFlight() const
+	{
+		return this->inFlight;
+	}
+
+	size_t getQueueDepth() const
+	{
+		return this->queueDepth;
+	}
+
+	size_t getAlignment() const
+	{
+		return this->alignment;
+	}
+
+	const wchar_t* getName() const
+	{
+		return this->alignment > 1 ? L"io_uring, direct" : L"io_uring";
+	}
+};
+
+std::unique_ptr<DHFS4_1_AsyncReader> createUringReader(DHFS_4_1_ReaderInterface& reader, int fd, DHFS4_1_ReadCounters& counters, size_t queueDepth, size_t alignment)
+{
+	wchar_t value[16] = { 0 };
+	DWORD length = GetEnvironmentVariableW(L"DHFS4_1_IO_URING", value, 16);
+
+	if (length > 0 && length < 16 && wcstoul(value, nullptr, 10) == 0)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<DHFS4_1_UringReader> uringReader = std::make_unique<DHFS4_1_UringReader>(reader, fd, counters, max(queueDepth, size_t(1)), alignment);
+	if (!uringReader->setup())
+	{
+		return nullptr;
+	}
+	return uringReader;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+
+// Keeps several reads in flight instead of waiting for each one, so a NVMe drive sees a real queue.
+// The consumer submits ahead and takes the completions in whatever order they finish.
+// io_uring on Linux, a small thread pool of blocking reads everywhere else.
+
+#define DHFS4_1_QUEUE_DEPTH 32 // default reads in flight, the environment variable DHFS4_1_QUEUE_DEPTH overrides it
+#define DHFS4_1_MAX_QUEUE_DEPTH 256
+
+// What a reader asked the system for, shared with its io_uring
+struct DHFS4_1_ReadCounters {
+	std::atomic<uint64_t> bytes = 0;
+	std::atomic<uint64_t> calls = 0;
+};
+
+class DHFS4_1_AsyncReader
+{
+public:
+	virtual ~DHFS4_1_AsyncReader() = default;
+
+	// Starts the read, the caller keeps at most getQueueDepth() in flight and the destination alive until it completed
+	virtual void submit(const DHFS4_1_ReadRequest& request, uint64_t tag) = 0;
+
+	// Waits for the next finished read, returns false if nothing is in flight.
+	// success is false if the read failed, the destination holds zeroes instead of the missing bytes then.
+	virtual BOOL wait(uint64_t& tag, BOOL& success) = 0;
+
+	virtual size_t getInFlight() const = 0;
+
+	virtual size_t getQueueDepth() const = 0;
+
+	// Offsets, lengths and destinations of the requests must be multiples of it, 1 for cached reads
+	virtual size_t getAlignment() const = 0;
+
+	virtual const wchar_t* getName() const = 0;
+};
+
+// DHFS4_1_QUEUE_DEPTH or the environment variable of the same name
+uint32_t getQueueDepth();
+
+// Runs readBytesInto of the reader on queueDepth threads, works with every reader
+std::unique_ptr<DHFS4_1_AsyncReader> createThreadPoolReader(DHFS_4_1_ReaderInterface& reader, size_t queueDepth);
+
+// Runs read on queueDepth threads, it zeroes what it couldn't read like readBytesInto
+std::unique_ptr<DHFS4_1_AsyncReader> createThreadPoolReader(const std::function<BOOL(uint64_t, uint64_t, BYTE*)>& read, size_t queueDepth, size_t alignment);
+
+#ifdef __linux__
+// io_uring on the file descriptor, nullptr if the kernel doesn't offer it or DHFS4_1_IO_URING=0.
+// Short and failed reads are finished with readBytesInto of the reader, which has to be the one reading fd.
+// The reads and system calls of the ring are added to the counters of the reader.
+std::unique_ptr<DHFS4_1_AsyncReader> createUringReader(DHFS_4_1_ReaderInterface& reader, int fd, DHFS4_1_ReadCounters& counters, size_t queueDepth, size_t alignment = 1);
+#endif
@@ -0,0 +1,127 @@
+#include "pch.h"
+#include "dhfs4_1_buffers.h"
+
+static std::atomic<uint64_t> bufferAllocations = 0;
+static std::atomic<uint64_t> bufferReuses = 0;
+static std::atomic<uint64_t> bufferFrees = 0;
+static std::atomic<uint64_t> bufferOversized = 0;
+
+static BYTE* allocateAligned(uint64_t capacity)
+{
+	bufferAllocations++;
+	return static_cast<BYTE*>(::operator new[](capacity, std::align_val_t(DHFS4_1_BUFFER_ALIGNMENT)));
+}
+
+static void freeAligned(BYTE* buffer)
+{
+	bufferFrees++;
+	::operator delete[](buffer, std::align_val_t(DHFS4_1_BUFFER_ALIGNMENT));
+}
+
+class DHFS4_1_BufferPool
+{
+private:
+	// A few buffers per class are enough, every thread only holds a handful at once
+	static const size_t maxPooled = 8;
+
+	std::vector<BYTE*> smallBuffers;
+	std::vector<BYTE*> clusterBuffers;
+
+	std::vector<BYTE*>* getClass(uint64_t capacity)
+	{
+		if (capacity == DHFS4_1_BUFFER_SMALL_SIZE)
+		{
+			return &this->smallBuffers;
+		}
+		if (capacity == DHFS4_1_BUFFER_CLUSTER_SIZE)
+		{
+			return &this->clusterBuffers;
+		}
+		return nullptr;
+	}
+
+public:
+	~DHFS4_1_BufferPool()
+	{
+		for (BYTE* buffer : this->smallBuffers)
+		{
+			freeAligned(buffer);
+		}
+		for (BYTE* buffer : this->clusterBuffers)
+		{
+			freeAligned(buffer);
+		}
+	}
+
+	BYTE* acquire(uint64_t capacity)
+	{
+		std::vector<BYTE*>* pooled = getClass(capacity);
+
+		if (pooled != nullptr && !pooled->empty())
+		{
+			BYTE* buffer = pooled->back();
+			pooled->pop_back();
+			bufferReuses++;
+			return buffer;
+		}
+		return allocateAligned(capacity);
+	}
+
+	void release(BYTE* buffer, uint64_t capacity)
+	{
+		std::vector<BYTE*>* pooled = getClass(capacity);
+
+		if (pooled != nullptr && pooled->size() < maxPooled)
+		{
+			pooled->push_back(buffer);
+			return;
+		}
+		freeAligned(buffer);
+	}
+
+	static DHFS4_1_BufferPool& local()
+	{
+		thread_local DHFS4_1_BufferPool pool;
+		return pool;
+	}
+};
+
+void DHFS4_1_BufferDeleter::operator()(BYTE* buffer) const
+{
+	if (buffer != nullptr)
+	{
+		DHFS4_1_BufferPool::local().release(buffer, this->capacity);
+	}
+}
+
+DHFS4_1_Buffer acquireBuffer(uint64_t size)
+{
+	uint64_t capacity = 0;
+
+	if (size <= DHFS4_1_BUFFER_SMALL_SIZE)
+	{
+		capacity = DHFS4_1_BUFFER_SMALL_SIZE;
+	}
+	else if (size <= DHFS4_1_BUFFER_CLUSTER_SIZE)
+	{
+		capacity = DHFS4_1_BUFFER_CLUSTER_SIZE;
+	}
+	else
+	{
+		// Rounded to whole sectors, never pooled
+		capacity = (size + 511) & ~511ULL;
+		bufferOversized++;
+	}
+
+	return DHFS4_1_Buffer(DHFS4_1_BufferPool::local().acquire(capacity), DHFS4_1_BufferDeleter{ capacity });
+}
+
+DHFS4_1_BufferStatistics getBufferStatistics()
+{
+	DHFS4_1_BufferStatistics statistics;
+	statistics.allocations = bufferAllocations;
+	statistics.reuses = bufferReuses;
+	statistics.frees = bufferFrees;
+	statistics.oversized = bufferOversized;
+	return statistics;
+}
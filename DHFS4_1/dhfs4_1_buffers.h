@@ -0,0 +1,29 @@
+#pragma once
+
+// Sector aligned I/O buffers, recycled per thread instead of new/delete for every read.
+// Requests are rounded up to one of two size classes: one sector and one cluster (2 MB).
+// Anything bigger is allocated and freed directly.
+
+#define DHFS4_1_BUFFER_ALIGNMENT 4096
+#define DHFS4_1_BUFFER_SMALL_SIZE 512ULL
+#define DHFS4_1_BUFFER_CLUSTER_SIZE (4096ULL * 512ULL)
+
+struct DHFS4_1_BufferStatistics {
+	uint64_t allocations; // fresh allocations from the heap
+	uint64_t reuses; // requests served from a pool
+	uint64_t frees; // buffers given back to the heap
+	uint64_t oversized; // requests bigger than a cluster
+};
+
+struct DHFS4_1_BufferDeleter {
+	uint64_t capacity;
+
+	void operator()(BYTE* buffer) const;
+};
+
+typedef std::unique_ptr<BYTE[], DHFS4_1_BufferDeleter> DHFS4_1_Buffer;
+
+// Borrows a buffer of at least size bytes, it goes back to the pool when the DHFS4_1_Buffer is destroyed
+DHFS4_1_Buffer acquireBuffer(uint64_t size);
+
+DHFS4_1_BufferStatistics getBufferStatistics();
@@ -0,0 +1,619 @@
+#include "pch.h"
+#include "dhfs4_1_carver.h"
+#include "dhfs4_1_asyncreader.h"
+
+DHFS4_1_CarveSettings getCarveSettings()
+{
+	DHFS4_1_CarveSettings settings;
+	settings.threadCount = std::thread::hardware_concurrency();
+
+	wchar_t value[16] = { 0 };
+	DWORD length = GetEnvironmentVariableW(L"DHFS4_1_THREADS", value, 16);
+
+	if (length > 0 && length < 16)
+	{
+		settings.threadCount = wcstoul(value, nullptr, 10);
+	}
+
+	if (settings.threadCount == 0)
+	{
+		settings.threadCount = 1;
+	}
+	if (settings.threadCount > DHFS4_1_CARVE_MAX_THREADS)
+	{
+		settings.threadCount = DHFS4_1_CARVE_MAX_THREADS;
+	}
+
+	settings.queueDepth = getQueueDepth();
+
+	return settings;
+}
+
+// buffer holds the cluster from bufferStart to clusterBytes, hits are the signatures found in it.
+// Frames crossing the cluster end are kept as fragCarved heads, footers of later clusters complete them.
+void carveCluster(const BYTE* buffer, uint64_t bufferStart, uint64_t clusterBytes, const std::vector<DHFS4_1_SignatureHit>& hits, DHFS4_1_CarvedCluster& carvedCluster)
+{
+	uint64_t j = bufferStart;
+
+	// The timestamps of all complete headers are validated in one go up front
+	thread_local std::vector<uint32_t> headerTimes;
+	thread_local std::vector<uint8_t> validTimes;
+
+	headerTimes.resize(hits.size());
+	validTimes.resize(hits.size());
+
+	for (size_t h = 0; h < hits.size(); h++)
+	{
+		headerTimes[h] = 0;
+
+		if (hits[h].type == DHFS4_1_SignatureType::header && bufferStart + hits[h].offset + 20 <= clusterBytes)
+		{
+			memcpy(&headerTimes[h], buffer + hits[h].offset + 16, 4);
+		}
+	}
+
+	validateDHFSTimes(headerTimes.data(), hits.size(), validTimes.data());
+
+	// Only the signature positions are looked at, everything between them is skipped like j++ did
+	for (size_t h = 0; h < hits.size(); h++)
+	{
+		const DHFS4_1_SignatureHit& hit = hits[h];
+
+		if (bufferStart + hit.offset < j)
+		{
+			continue;
+		}
+
+		j = bufferStart + hit.offset;
+		const BYTE* position = buffer + hit.offset;
+
+		if (hit.type == DHFS4_1_SignatureType::header)
+		{
+			uint16_t camera = 0;
+			uint32_t length = 0;
+			uint32_t dhfsTimestamp = 0;
+
+			// Header is cut off by the cluster end
+			if (j + 20 > clusterBytes)
+			{
+				j++;
+				continue;
+			}
+
+			memcpy(&camera, position + 6, 2);
+			memcpy(&length, position + 12, 4);
+			memcpy(&dhfsTimestamp, position + 16, 4);
+
+			// probably no real DHAV frame, so skip this
+			if (length < 8 || dhfsTimestamp == 0)
+			{
+				j++;
+				continue;
+			}
+
+			if (!validTimes[h])
+			{
+				j++;
+				continue;
+			}
+
+			DHFS4_1_Videoframe carvedVideoFrame;
+			carvedVideoFrame.beginDate = dhfsTimestamp;
+			carvedVideoFrame.length = length;
+			carvedVideoFrame.mainDescriptorId = carvedCluster.descriptorId;
+			carvedVideoFrame.status = DHF4_1_DescriptorStatus::carved;
+			carvedVideoFrame.camera = camera;
+			carvedVideoFrame.bytesDue = 0;
+			carvedVideoFrame.videoOffset = j;
+
+			// Videoframe is within cluster, so no internal fragmentation
+			if (length + j < clusterBytes)
+			{
+				uint32_t footerLength = 0;
+
+				memcpy(&footerLength, position + length - 4, 4);
+
+				// Matching footer in fragment
+				if (footerLength == length && std::memcmp(position + length - 8, "dhav", 4) == 0)
+				{
+					j = j + length;
+				}
+				// No matching footer, so probably no real frame
+				else
+				{
+					j++;
+					continue;
+				}
+
+				// If the matching footer isn't necessary comment above code out
+				// j = j + length
+			}
+			else
+			{
+				carvedVideoFrame.status = DHF4_1_DescriptorStatus::fragCarved;
+				carvedVideoFrame.bytesDue = (-1) * ((clusterBytes - j) - (length));
+				carvedCluster.frames.push_back(carvedVideoFrame);
+				break;
+			}
+			carvedCluster.frames.push_back(carvedVideoFrame);
+		}
+		else
+		{
+			uint32_t length = 0;
+
+			if (j + 8 > clusterBytes)
+			{
+				j++;
+				continue;
+			}
+
+			memcpy(&length, position + 4, 4);
+
+			// again, probably no real dhav footer
+			if (length == 0)
+			{
+				j++;
+				continue;
+			}
+
+			// 4 bytes dhav, 4 bytes length
+			j += 8;
+
+			DHFS4_1_CarvedFooter footer;
+			footer.length = length;
+			footer.end = j;
+			footer.frameIndex = carvedCluster.frames.size();
+
+			carvedCluster.footers.push_back(footer);
+		}
+	}
+}
+
+void DHFS4_1_PendingHeads::add(uint32_t length, uint32_t bytesDue, size_t frameIndex)
+{
+	uint64_t key = makeKey(length, bytesDue);
+
+	this->heads[key].push_back(frameIndex);
+
+	Entry entry;
+	entry.cluster = this->clusterCount;
+	entry.key = key;
+	entry.frameIndex = frameIndex;
+
+	this->entries.push_back(entry);
+}
+
+void DHFS4_1_PendingHeads::take(uint32_t length, uint32_t bytesDue, std::vector<size_t>& frameIndices)
+{
+	auto found = this->heads.find(makeKey(length, bytesDue));
+	if (found == this->heads.end())
+	{
+		return;
+	}
+
+	frameIndices.insert(frameIndices.end(), found->second.rbegin(), found->second.rend());
+
+	// The entries are left to the expiry, they don't match anything anymore
+	this->heads.erase(found);
+}
+
+void DHFS4_1_PendingHeads::nextCluster()
+{
+	this->clusterCount++;
+
+	while (!this->entries.empty() && this->entries.front().cluster + DHFS4_1_CARVE_PENDING_CLUSTERS <= this->clusterCount)
+	{
+		const Entry& entry = this->entries.front();
+
+		// Heads of a key are added in order, so an expired one still waiting is the oldest of its key
+		auto found = this->heads.find(entry.key);
+		if (found != this->heads.end() && found->second.front() == entry.frameIndex)
+		{
+			found->second.pop_front();
+
+			if (found->second.empty())
+			{
+				this->heads.erase(found);
+			}
+		}
+
+		this->entries.pop_front();
+	}
+}
+
+void mergeCarvedCluster(const DHFS4_1_CarvedCluster& carvedCluster, std::vector<DHFS4_1_Videoframe>& carvedVideoFrames, DHFS4_1_PendingHeads& pendingHeads)
+{
+	size_t frameIndex = 0;
+	std::vector<size_t> matchedHeads;
+
+	auto pushFrames = [&](size_t end)
+	{
+		for (; frameIndex < end; frameIndex++)
+		{
+			const DHFS4_1_Videoframe& carvedVideoFrame = carvedCluster.frames[frameIndex];
+
+			if (carvedVideoFrame.status == DHF4_1_DescriptorStatus::fragCarved)
+			{
+				pendingHeads.add(carvedVideoFrame.length, carvedVideoFrame.bytesDue, carvedVideoFrames.size());
+			}
+			carvedVideoFrames.push_back(carvedVideoFrame);
+		}
+	};
+
+	for (const DHFS4_1_CarvedFooter& footer : carvedCluster.footers)
+	{
+		// Keep the order in which the frames and footers were found in the cluster
+		pushFrames(footer.frameIndex);
+
+		// A DHAV head which
+		// 1. got the same length as the footer
+		// 2. is fragmented due to the cluster size
+		// 3. the pending bytes are the same as the offset to the dhav ending
+		matchedHeads.clear();
+		pendingHeads.take(footer.length, footer.end, matchedHeads);
+
+		for (size_t i : matchedHeads)
+		{
+			DHFS4_1_Videoframe carvedVideoTail;
+			carvedVideoTail.beginDate = carvedVideoFrames[i].beginDate;
+			carvedVideoTail.length = footer.end;
+			carvedVideoTail.mainDescriptorId = carvedCluster.descriptorId;
+			carvedVideoTail.status = DHF4_1_DescriptorStatus::carved;
+			carvedVideoTail.camera = (carvedVideoFrames[i].camera & 0x0F) + 1;
+			carvedVideoTail.bytesDue = 0;
+			carvedVideoTail.videoOffset = 0;
+
+			carvedVideoFrames[i].status = DHF4_1_DescriptorStatus::carved;
+
+			carvedVideoFrames.push_back(carvedVideoTail);
+		}
+	}
+
+	pushFrames(carvedCluster.frames.size());
+	pendingHeads.nextCluster();
+}
+
+BOOL carveClusters(DHFS_4_1_ReaderInterface& reader, uint64_t clusterBytes, const std::vector<DHFS4_1_CarveJob>& jobs, const DHFS4_1_CarveSettings& settings, std::vector<DHFS4_1_Videoframe>& carvedVideoFrames, const std::function<BOOL(size_t)>& progress)
+{
+	size_t batchCount = (jobs.size() + DHFS4_1_CARVE_BATCH_SIZE - 1) / DHFS4_1_CARVE_BATCH_SIZE;
+	size_t threadCount = min(size_t(settings.threadCount), batchCount);
+	DHFS4_1_PendingHeads pendingHeads;
+
+	if (threadCount == 0)
+	{
+		return true;
+	}
+
+	// Heads merged before, by an interrupted run, can still be completed by the footers of these jobs
+	for (size_t i = 0; i < carvedVideoFrames.size(); i++)
+	{
+		if (carvedVideoFrames[i].status == DHF4_1_DescriptorStatus::fragCarved)
+		{
+			pendingHeads.add(carvedVideoFrames[i].length, carvedVideoFrames[i].bytesDue, i);
+		}
+	}
+
+	std::vector<DHFS4_1_CarvedCluster> carvedClusters(jobs.size());
+	std::vector<uint8_t> batchDone(batchCount, 0);
+	std::atomic<size_t> nextBatch = 0;
+	size_t mergedBatches = 0;
+	BOOL stopped = false;
+	size_t window = threadCount * DHFS4_1_CARVE_WINDOW;
+
+	std::mutex mutex;
+	std::condition_variable batchReady;
+	std::condition_variable batchMerged;
+
+	// The reads in flight are shared by the workers, each one keeps its part of the queue busy
+	size_t queueDepth = max(size_t(1), size_t(settings.queueDepth) / threadCount);
+
+	// Idle workers take the next batch, so a slow read only holds up the thread doing it.
+	// Each worker submits the reads of its next clusters ahead and scans every cluster as soon as it arrived,
+	// so the reads overlap with the scanning and the device always has queueDepth reads per worker.
+	auto worker = [&]()
+	{
+		std::vector<DHFS4_1_SignatureHit> signatureHits;
+		DHFS4_1_Buffer readBuffer; // one cluster per slot of the queue, outlives the reads into it
+		std::unique_ptr<DHFS4_1_AsyncReader> asyncReader;
+		uint64_t alignment = 1;
+		uint64_t slotBytes = clusterBytes;
+		std::vector<size_t> freeSlots;
+		std::deque<std::pair<size_t, size_t>> openBatches; // claimed batches and their clusters not scanned yet
+		size_t claimedBatch = SIZE_MAX; // taken, but its reads wait for the merge
+		size_t nextJob = 0;
+		size_t batchEnd = 0;
+		BOOL exhausted = false;
+		BOOL cancelled = false;
+
+		for (size_t slot = queueDepth; slot > 0; slot--)
+		{
+			freeSlots.push_back(slot - 1);
+		}
+
+		auto scan = [&](size_t k, const BYTE* cluster)
+		{
+			const DHFS4_1_CarveJob& job = jobs[k];
+			DHFS4_1_CarvedCluster& carvedCluster = carvedClusters[k];
+			uint64_t length = clusterBytes - job.slackStart;
+
+			carvedCluster.descriptorId = job.descriptorId;
+
+			signatureHits.clear();
+			scanDhavSignatures(cluster, length, signatureHits);
+			carveCluster(cluster, job.slackStart, clusterBytes, signatureHits, carvedCluster);
+
+			// The clusters of a batch arrive in any order, it's done with the last one
+			size_t batch = k / DHFS4_1_CARVE_BATCH_SIZE;
+			for (auto openBatch = openBatches.begin(); openBatch != openBatches.end(); openBatch++)
+			{
+				if (openBatch->first == batch)
+				{
+					if (--openBatch->second == 0)
+					{
+						openBatches.erase(openBatch);
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							batchDone[batch] = 1;
+						}
+						batchReady.notify_all();
+					}
+					break;
+				}
+			}
+		};
+
+		while (true)
+		{
+			BOOL inFlight = asyncReader != nullptr && asyncReader->getInFlight() > 0;
+
+			// Submit ahead while there is a free slot
+			while (!exhausted && !cancelled && !freeSlots.empty())
+			{
+				if (nextJob == batchEnd)
+				{
+					if (claimedBatch == SIZE_MAX)
+					{
+						claimedBatch = nextBatch.fetch_add(1);
+						if (claimedBatch >= batchCount)
+						{
+							exhausted = true;
+							break;
+						}
+					}
+
+					// Don't run too far ahead of the merge, the results are kept until then.
+					// With reads in flight they are finished first instead, the merge may wait for them.
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						if (inFlight)
+						{
+							if (!stopped && claimedBatch >= mergedBatches + window)
+							{
+								break;
+							}
+						}
+						else
+						{
+							batchMerged.wait(lock, [&]() { return stopped || claimedBatch < mergedBatches + window; });
+						}
+
+						if (stopped)
+						{
+							cancelled = true;
+							break;
+						}
+					}
+
+					nextJob = claimedBatch * DHFS4_1_CARVE_BATCH_SIZE;
+					batchEnd = min(jobs.size(), nextJob + DHFS4_1_CARVE_BATCH_SIZE);
+					openBatches.push_back({ claimedBatch, batchEnd - nextJob });
+					claimedBatch = SIZE_MAX;
+				}
+
+				const DHFS4_1_CarveJob& job = jobs[nextJob];
+				uint64_t length = clusterBytes - job.slackStart;
+
+				// A mapped image is scanned in place, without a read
+				std::span<const std::byte> view = reader.viewBytes(job.clusterOffset + job.slackStart, length);
+				if (view.size() == length)
+				{
+					scan(nextJob++, reinterpret_cast<const BYTE*>(view.data()));
+					continue;
+				}
+
+				if (asyncReader == nullptr)
+				{
+					// A direct reader needs aligned reads, a slot has room for the cluster rounded out to both sides
+					asyncReader = reader.createStreamReader(queueDepth);
+					alignment = asyncReader->getAlignment();
+					slotBytes = (clusterBytes + alignment - 1 + alignment - 1) / alignment * alignment;
+					readBuffer = acquireBuffer(queueDepth * slotBytes);
+				}
+
+				size_t slot = freeSlots.back();
+				freeSlots.pop_back();
+
+				uint64_t readStart = job.clusterOffset + job.slackStart;
+				uint64_t alignedStart = readStart - readStart % alignment;
+				uint64_t alignedEnd = (readStart + length + alignment - 1) / alignment * alignment;
+
+				// The tag keeps the job and its slot
+				asyncReader->submit({ alignedStart, alignedEnd - alignedStart, readBuffer.get() + slot * slotBytes }, uint64_t(nextJob) * queueDepth + slot);
+				nextJob++;
+				inFlight = true;
+			}
+
+			uint64_t tag;
+			BOOL success;
+
+			if (asyncReader == nullptr || !asyncReader->wait(tag, success))
+			{
+				if (exhausted || cancelled)
+				{
+					return;
+				}
+				continue;
+			}
+
+			size_t slot = tag % queueDepth;
+			freeSlots.push_back(slot);
+
+			// After a stop the reads in flight are only waited for, the buffer must outlive them
+			if (!cancelled)
+			{
+				const DHFS4_1_CarveJob& job = jobs[tag / queueDepth];
+				uint64_t readStart = job.clusterOffset + job.slackStart;
+				scan(tag / queueDepth, readBuffer.get() + slot * slotBytes + readStart % alignment);
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(worker);
+	}
+
+	for (size_t batch = 0; batch < batchCount; batch++)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			batchReady.wait(lock, [&]() { return batchDone[batch] != 0; });
+		}
+
+		size_t end = min(jobs.size(), (batch + 1) * DHFS4_1_CARVE_BATCH_SIZE);
+
+		for (size_t k = batch * DHFS4_1_CARVE_BATCH_SIZE; k < end; k++)
+		{
+			mergeCarvedCluster(carvedClusters[k], carvedVideoFrames, pendingHeads);
+			carvedClusters[k] = DHFS4_1_CarvedCluster();
+		}
+
+		BOOL proceed = progress(end);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			mergedBatches = batch + 1;
+			stopped = !proceed;
+		}
+		batchMerged.notify_all();
+
+		if (!proceed)
+		{
+			break;
+		}
+	}
+
+	for (std::thread& thread : workers)
+	{
+		thread.join();
+	}
+
+	return !stopped;
+}
+
+// Stable LSD radix sort by key, one pass per byte. Bytes which are the same for all keys are skipped,
+// so mostly only the low bytes of the timestamp and the camera byte are sorted.
+static void sortCarvedFrameKeys(std::vector<DHFS4_1_CarvedFrameKey>& frameKeys)
+{
+	std::vector<DHFS4_1_CarvedFrameKey> sorted(frameKeys.size());
+
+	for (int shift = 0; shift < 40; shift += 8)
+	{
+		size_t counts[256] = { 0 };
+
+		for (const DHFS4_1_CarvedFrameKey& frameKey : frameKeys)
+		{
+			counts[(frameKey.key >> shift) & 0xFF]++;
+		}
+
+		if (counts[(frameKeys[0].key >> shift) & 0xFF] == frameKeys.size())
+		{
+			continue;
+		}
+
+		size_t position = 0;
+		for (size_t& count : counts)
+		{
+			size_t next = position + count;
+			count = position;
+			position = next;
+		}
+
+		for (const DHFS4_1_CarvedFrameKey& frameKey : frameKeys)
+		{
+			sorted[counts[(frameKey.key >> shift) & 0xFF]++] = frameKey;
+		}
+
+		frameKeys.swap(sorted);
+	}
+}
+
+void assembleCarvedDescriptors(const std::vector<DHFS4_1_Videoframe>& carvedVideoFrames, std::vector<DHFS4_1_Descriptor>& carvedDescriptors)
+{
+	uint32_t bitmask = ~((1U << 12) - 1);
+
+	if (carvedVideoFrames.empty())
+	{
+		return;
+	}
+
+	// The camera was always cut to 8 bits for the grouping
+	std::vector<DHFS4_1_CarvedFrameKey> frameKeys(carvedVideoFrames.size());
+	for (size_t i = 0; i < carvedVideoFrames.size(); i++)
+	{
+		frameKeys[i].key = (uint64_t(uint8_t(carvedVideoFrames[i].camera)) << 32) | carvedVideoFrames[i].beginDate;
+		frameKeys[i].frameIndex = i;
+	}
+
+	sortCarvedFrameKeys(frameKeys);
+
+	int index = 0;
+	size_t begin = 0;
+
+	while (begin < frameKeys.size())
+	{
+		// Same camera and hour, so the stream is the slice up to the next change of the upper key bits
+		uint64_t streamKey = frameKeys[begin].key & ~uint64_t(~bitmask);
+		size_t end = begin + 1;
+
+		while (end < frameKeys.size() && (frameKeys[end].key & ~uint64_t(~bitmask)) == streamKey)
+		{
+			end++;
+		}
+
+		// the duration is not exactly 1 hour, but now the fragments can assign to a time range...
+		DHFS4_1_Descriptor descriptor;
+		descriptor.beginDate = uint32_t(streamKey);
+		descriptor.endDate = (uint32_t(streamKey) + 4096) & bitmask;
+		descriptor.camera = uint8_t(streamKey >> 32);
+		descriptor.id = index;
+		descriptor.videoFragments.reserve(end - begin);
+
+		uint64_t offsetInStream = 0;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			const DHFS4_1_Videoframe& carvedVideoFrame = carvedVideoFrames[frameKeys[i].frameIndex];
+
+			DHFS4_1_VideoFragment videoFragment;
+			videoFragment.beginDate = carvedVideoFrame.beginDate;
+			videoFragment.endDate = (carvedVideoFrame.beginDate + 4096) & bitmask;
+			videoFragment.offset = carvedVideoFrame.videoOffset;
+			videoFragment.mainDescriptorId = carvedVideoFrame.mainDescriptorId;
+			videoFragment.id = carvedVideoFrame.mainDescriptorId;
+			videoFragment.nextFragmentId = i < end - 1 ? carvedVideoFrames[frameKeys[i + 1].frameIndex].mainDescriptorId : 0;
+			videoFragment.prevFragmentId = i > begin ? carvedVideoFrames[frameKeys[i - 1].frameIndex].mainDescriptorId : 0;
+			videoFragment.fragmentSize = carvedVideoFrame.length - carvedVideoFrame.bytesDue; // to get the size in this fragment, not the total size
+			videoFragment.offsetInStream = offsetInStream;
+
+			offsetInStream += videoFragment.fragmentSize;
+
+			descriptor.videoFragments.push_back(videoFragment);
+		}
+
+		carvedDescriptors.push_back(std::move(descriptor));
+		index++;
+		begin = end;
+	}
+}
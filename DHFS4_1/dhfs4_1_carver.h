@@ -0,0 +1,95 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+#include "dhfs4_1_scanner.h"
+
+// Carving of free clusters and slack space on several threads.
+// Workers read and scan batches of clusters, the calling thread merges their results in job order,
+// so the carved frames are the same no matter how many threads are used.
+
+#define DHFS4_1_CARVE_BATCH_SIZE 16 // clusters a worker takes at once
+#define DHFS4_1_CARVE_WINDOW 4 // batches per worker which may be done but not merged yet
+#define DHFS4_1_CARVE_MAX_THREADS 64
+#define DHFS4_1_CARVE_PENDING_CLUSTERS 4096 // clusters a fragmented head waits for its footer
+
+struct DHFS4_1_CarveSettings {
+	uint32_t threadCount;
+	uint32_t queueDepth; // reads in flight of all workers together
+};
+
+// A cluster, or only the slack behind the last fragment of a cluster
+struct DHFS4_1_CarveJob {
+	uint32_t descriptorId;
+	uint64_t clusterOffset; // byte offset of the cluster on the disk
+	uint64_t slackStart; // bytes at the start of the cluster which are skipped, 0 for the whole cluster
+};
+
+// A dhav footer, it can only complete fragmented heads of earlier clusters, so it's matched during the merge
+struct DHFS4_1_CarvedFooter {
+	uint32_t length;
+	uint32_t end; // offset behind the footer in its cluster
+	size_t frameIndex; // frames of the same cluster found in front of the footer
+};
+
+struct DHFS4_1_CarvedCluster {
+	uint32_t descriptorId;
+	std::vector<DHFS4_1_Videoframe> frames;
+	std::vector<DHFS4_1_CarvedFooter> footers;
+};
+
+// Fragmented heads which still wait for their footer, looked up by (length, bytesDue).
+// A head is dropped when it's matched or after DHFS4_1_CARVE_PENDING_CLUSTERS clusters without a match.
+class DHFS4_1_PendingHeads
+{
+private:
+	struct Entry {
+		uint64_t cluster;
+		uint64_t key;
+		size_t frameIndex;
+	};
+
+	std::unordered_map<uint64_t, std::deque<size_t>> heads; // key -> indices in carvedVideoFrames, oldest first
+	std::deque<Entry> entries; // all heads in the order they were added, for the expiry
+	uint64_t clusterCount = 0;
+
+	static uint64_t makeKey(uint32_t length, uint32_t bytesDue)
+	{
+		return (uint64_t(length) << 32) | bytesDue;
+	}
+
+public:
+	void add(uint32_t length, uint32_t bytesDue, size_t frameIndex);
+
+	// Removes all heads matching the footer and appends their indices, newest first
+	void take(uint32_t length, uint32_t bytesDue, std::vector<size_t>& frameIndices);
+
+	// Called after each merged cluster, drops the heads which waited too long
+	void nextCluster();
+
+	size_t size() const
+	{
+		return this->entries.size();
+	}
+};
+
+// Carved frames are grouped to streams per camera and hour, the frames of a stream are ordered by time
+// and then by the order they were found in
+struct DHFS4_1_CarvedFrameKey {
+	uint64_t key; // camera << 32 | beginDate
+	uint32_t frameIndex;
+};
+
+// One thread per core, DHFS4_1_THREADS in the environment overrides it
+DHFS4_1_CarveSettings getCarveSettings();
+
+void carveCluster(const BYTE* buffer, uint64_t bufferStart, uint64_t clusterBytes, const std::vector<DHFS4_1_SignatureHit>& hits, DHFS4_1_CarvedCluster& carvedCluster);
+
+void mergeCarvedCluster(const DHFS4_1_CarvedCluster& carvedCluster, std::vector<DHFS4_1_Videoframe>& carvedVideoFrames, DHFS4_1_PendingHeads& pendingHeads);
+
+// Appends the frames of all jobs to carvedVideoFrames in job order, frames already in there are continued.
+// progress is called on the calling thread with the number of merged jobs, host functions are safe to use there.
+// When it returns false the workers stop after their current batch and false is returned.
+BOOL carveClusters(DHFS_4_1_ReaderInterface& reader, uint64_t clusterBytes, const std::vector<DHFS4_1_CarveJob>& jobs, const DHFS4_1_CarveSettings& settings, std::vector<DHFS4_1_Videoframe>& carvedVideoFrames, const std::function<BOOL(size_t)>& progress);
+
+// Creates one descriptor per stream of the carved frames, which can be used for the VS items
+void assembleCarvedDescriptors(const std::vector<DHFS4_1_Videoframe>& carvedVideoFrames, std::vector<DHFS4_1_Descriptor>& carvedDescriptors);
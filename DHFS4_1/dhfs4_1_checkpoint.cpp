@@ -0,0 +1,191 @@
+#include "pch.h"
+#include "dhfs4_1_checkpoint.h"
+
+std::wstring getCheckpointPath(const DHFS4_1_ImageIdentity& identity)
+{
+	std::vector<std::wstring> indexPaths = getIndexPaths(identity);
+
+	if (indexPaths.empty())
+	{
+		return std::wstring();
+	}
+
+	// Same directory and name as the index the run is going to write
+	std::wstring path = indexPaths.front();
+	return path.substr(0, path.size() - 4) + L".ckpt";
+}
+
+static BOOL readSection(HANDLE hFile, void* data, uint64_t length)
+{
+	BYTE* position = static_cast<BYTE*>(data);
+
+	while (length > 0)
+	{
+		DWORD chunk = static_cast<DWORD>(min(length, 0x10000000ULL));
+		DWORD read = 0;
+		if (!ReadFile(hFile, position, chunk, &read, NULL) || read != chunk)
+		{
+			return false;
+		}
+		position += chunk;
+		length -= chunk;
+	}
+	return true;
+}
+
+static BOOL readFrames(HANDLE hFile, uint64_t count, uint64_t fileSize, std::vector<DHFS4_1_Videoframe>& frames)
+{
+	if (count > fileSize / sizeof(DHFS4_1_Videoframe))
+	{
+		return false;
+	}
+
+	frames.resize(count);
+	return readSection(hFile, frames.data(), count * sizeof(DHFS4_1_Videoframe));
+}
+
+BOOL DHFS4_1_Checkpoint::open(const std::wstring& path, const DHFS4_1_ImageIdentity& identity)
+{
+	this->path = path;
+	this->identity = identity;
+	this->partitions.clear();
+	this->lastSave = std::chrono::steady_clock::now();
+
+	if (path.empty())
+	{
+		return false;
+	}
+
+	HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(hFile, &fileSize);
+
+	DHFS4_1_CheckpointHeader header = {};
+	BOOL success = readSection(hFile, &header, sizeof(header)) &&
+		header.magic == DHFS4_1_CHECKPOINT_MAGIC &&
+		header.version == DHFS4_1_CHECKPOINT_VERSION &&
+		header.headerSize == sizeof(DHFS4_1_CheckpointHeader) &&
+		header.frameSize == sizeof(DHFS4_1_Videoframe) &&
+		header.imageSize == identity.imageSize &&
+		header.bootHash == identity.bootHash &&
+		header.partitionCount <= 256;
+
+	std::vector<DHFS4_1_CheckpointPartition> records(success ? header.partitionCount : 0);
+	success = success && readSection(hFile, records.data(), records.size() * sizeof(DHFS4_1_CheckpointPartition));
+
+	for (const DHFS4_1_CheckpointPartition& record : records)
+	{
+		if (!success || record.id >= header.partitionCount || record.phase > DHFS4_1_ScanPhase::done)
+		{
+			success = false;
+			break;
+		}
+
+		DHFS4_1_PartitionCheckpoint& state = getPartition(record.id);
+		state.phase = record.phase;
+		state.nextDescriptor = record.nextDescriptor;
+		state.carveJobsDone = record.carveJobsDone;
+		state.carvedItemsDone = record.carvedItemsDone;
+		state.rootId = record.rootId;
+		state.carvedRootId = record.carvedRootId;
+		state.fileCounter = record.fileCounter;
+
+		success = readFrames(hFile, record.freeFrameCount, fileSize.QuadPart, state.freeFrames) &&
+			readFrames(hFile, record.slackFrameCount, fileSize.QuadPart, state.slackFrames);
+	}
+
+	CloseHandle(hFile);
+
+	// A checkpoint which doesn't fit means a scan from the start, never a guess
+	if (!success)
+	{
+		this->partitions.clear();
+	}
+	return success && !this->partitions.empty();
+}
+
+BOOL DHFS4_1_Checkpoint::save(BOOL force)
+{
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
+	if (this->path.empty() || (!force && !isDue()))
+	{
+		return false;
+	}
+
+	this->lastSave = std::chrono::steady_clock::now();
+
+	DHFS4_1_CheckpointHeader header = {};
+	header.magic = DHFS4_1_CHECKPOINT_MAGIC;
+	header.version = DHFS4_1_CHECKPOINT_VERSION;
+	header.headerSize = sizeof(DHFS4_1_CheckpointHeader);
+	header.imageSize = this->identity.imageSize;
+	header.bootHash = this->identity.bootHash;
+	header.frameSize = sizeof(DHFS4_1_Videoframe);
+	header.partitionCount = static_cast<uint32_t>(this->partitions.size());
+
+	std::vector<DHFS4_1_CheckpointPartition> records;
+	for (uint32_t id = 0; id < this->partitions.size(); id++)
+	{
+		const DHFS4_1_PartitionCheckpoint& state = this->partitions[id];
+
+		DHFS4_1_CheckpointPartition record = {};
+		record.id = id;
+		record.phase = state.phase;
+		record.nextDescriptor = state.nextDescriptor;
+		record.carveJobsDone = state.carveJobsDone;
+		record.carvedItemsDone = state.carvedItemsDone;
+		record.rootId = state.rootId;
+		record.carvedRootId = state.carvedRootId;
+		record.fileCounter = state.fileCounter;
+		record.freeFrameCount = state.freeFrames.size();
+		record.slackFrameCount = state.slackFrames.size();
+		records.push_back(record);
+	}
+
+	// Written to a temporary file first, an interruption while saving keeps the previous checkpoint
+	std::wstring temporaryPath = this->path + L".tmp";
+	HANDLE hFile = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	BOOL success = writeSection(hFile, &header, sizeof(header)) &&
+		writeSection(hFile, records.data(), records.size() * sizeof(DHFS4_1_CheckpointPartition));
+
+	for (const DHFS4_1_PartitionCheckpoint& state : this->partitions)
+	{
+		success = success && writeSection(hFile, state.freeFrames.data(), state.freeFrames.size() * sizeof(DHFS4_1_Videoframe));
+		success = success && writeSection(hFile, state.slackFrames.data(), state.slackFrames.size() * sizeof(DHFS4_1_Videoframe));
+	}
+
+	CloseHandle(hFile);
+
+	if (!success || !MoveFileExW(temporaryPath.c_str(), this->path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(temporaryPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+void DHFS4_1_Checkpoint::remove()
+{
+	if (!this->path.empty())
+	{
+		DeleteFileW(this->path.c_str());
+	}
+	this->partitions.clear();
+}
+
+void DHFS4_1_Checkpoint::reset()
+{
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
+	this->partitions.clear();
+}
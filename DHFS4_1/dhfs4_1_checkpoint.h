@@ -0,0 +1,59 @@
+#pragma once
+
+#include "dhfs4_1_index.h"
+#include "dhfs4_1_scanstate.h"
+
+// Checkpoint of an interrupted XT_ProcessItemEx run, kept next to the index as DHFS4_1_<size>_<hash>.ckpt.
+// It records how far each partition got, so a rerun continues there instead of at sector 0.
+// Deleted after a complete run.
+
+#define DHFS4_1_CHECKPOINT_MAGIC 0x31504B4353464844ULL // "DHFSCKP1"
+#define DHFS4_1_CHECKPOINT_VERSION 1
+
+#pragma pack(push, 8)
+struct DHFS4_1_CheckpointHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t imageSize;
+	uint64_t bootHash;
+	uint32_t frameSize;
+	uint32_t partitionCount;
+};
+
+struct DHFS4_1_CheckpointPartition {
+	uint32_t id;
+	DHFS4_1_ScanPhase phase;
+	uint64_t nextDescriptor;
+	uint64_t carveJobsDone;
+	uint64_t carvedItemsDone;
+	int32_t rootId;
+	int32_t carvedRootId;
+	int32_t fileCounter;
+	uint32_t reserved;
+	uint64_t freeFrameCount;
+	uint64_t slackFrameCount;
+};
+#pragma pack(pop)
+
+std::wstring getCheckpointPath(const DHFS4_1_ImageIdentity& identity);
+
+class DHFS4_1_Checkpoint : public DHFS4_1_ScanState
+{
+private:
+	std::wstring path;
+	DHFS4_1_ImageIdentity identity = {};
+
+public:
+	// Loads the checkpoint at path if it belongs to the image, returns true if there is something to resume.
+	// Without a checkpoint it starts empty and saves to path.
+	BOOL open(const std::wstring& path, const DHFS4_1_ImageIdentity& identity);
+
+	// Writes the checkpoint if it's due, or always with force
+	BOOL save(BOOL force = false) override;
+
+	void remove();
+
+	// Forgets the loaded state, the run starts from the beginning and overwrites the file with its first save
+	void reset();
+};
@@ -0,0 +1,221 @@
+#include "pch.h"
+#include "dhfs4_1_parser.h"
+#include "dhfs4_1_filereader.h"
+#include "dhfs4_1_mappedreader.h"
+#include "dhfs4_1_asyncreader.h"
+#include "dhfs4_1_carver.h"
+#include "dhfs4_1_scanner.h"
+#include "dhfs4_1_progress.h"
+#include "dhfs4_1_dispatcher.h"
+#include <csignal>
+#include <cstdio>
+
+// Scans a DHFS4.1 image with the parser core and prints what the X-Tension would create.
+// Meant for batch runs on Linux and for measuring the parser without X-Ways.
+
+static std::atomic<BOOL> interrupted = false;
+
+static void onInterrupt(int)
+{
+	interrupted = true;
+}
+
+class DHFS4_1_ConsoleProgressHost : public DHFS4_1_ProgressHost
+{
+private:
+	std::wstring description;
+
+public:
+	void showProgress(const std::wstring& description)
+	{
+		this->description = description;
+	}
+
+	void setProgressPercentage(DWORD percent)
+	{
+		fprintf(stderr, "\r%ls: %u%%", this->description.c_str(), unsigned(percent));
+	}
+
+	void hideProgress()
+	{
+		fprintf(stderr, "\r%ls: done\n", this->description.c_str());
+	}
+
+	BOOL shouldStop()
+	{
+		return interrupted;
+	}
+};
+
+static DHFS4_1_ConsoleProgressHost progressHost;
+
+int main(int argc, char** argv)
+{
+	const char* imagePath = nullptr;
+	BOOL carve = true;
+	BOOL mapImage = true;
+	BOOL directStreaming = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--no-carve") == 0)
+		{
+			carve = false;
+		}
+		else if (strcmp(argv[i], "--pread") == 0)
+		{
+			mapImage = false;
+		}
+		else if (strcmp(argv[i], "--direct") == 0)
+		{
+			// The carving bypasses the page cache, that needs reads instead of the mapping
+			mapImage = false;
+			directStreaming = true;
+		}
+		else if (imagePath == nullptr)
+		{
+			imagePath = argv[i];
+		}
+		else
+		{
+			imagePath = nullptr;
+			break;
+		}
+	}
+
+	if (imagePath == nullptr)
+	{
+		fprintf(stderr, "Usage: %s <image or device> [--no-carve] [--pread] [--direct]\n", argv[0]);
+		return 2;
+	}
+
+	// The mapping lets the parser and the carver work on the page cache without copies,
+	// pread is the fallback for 32 bit builds and media with read errors
+	DHFS4_1_MappedReader mappedReader;
+	DHFS4_1_FileReader fileReader;
+	BOOL mapped = mapImage && mappedReader.map(imagePath);
+
+	if (!mapped && !fileReader.open(imagePath, directStreaming))
+	{
+		fprintf(stderr, "Couldn't open %s\n", imagePath);
+		return 1;
+	}
+
+	DHFS_4_1_ReaderInterface& reader = mapped ? static_cast<DHFS_4_1_ReaderInterface&>(mappedReader) : fileReader;
+
+	uint32_t dhfsId = 0;
+	reader.readBytesInto(0, 4, reinterpret_cast<BYTE*>(&dhfsId));
+
+	if (dhfsId != 0x53464844)
+	{
+		fprintf(stderr, "Wrong Dahua signature!\n");
+		return 1;
+	}
+
+	signal(SIGINT, onInterrupt);
+	setProgressHost(&progressHost);
+	resetStop();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<DHFS4_1_Partition> partitionTable;
+	readPartitionTable(reader, partitionTable);
+	for (DHFS4_1_Partition& partition : partitionTable)
+	{
+		readBootSector(reader, partition);
+	}
+
+	std::atomic<BOOL> stopped = false;
+	std::vector<std::function<void()>> workers;
+
+	// Same steps as the Disk I/O mode of the X-Tension without an index
+	for (DHFS4_1_Partition& partition : partitionTable)
+	{
+		workers.push_back([&reader, &partition, &stopped, carve]
+			{
+				if (!loadDescriptorTable(reader, partition))
+				{
+					fprintf(stderr, "Couldn't read the descriptor table of partition %u\n", unsigned(partition.id));
+					stopped = true;
+					return;
+				}
+
+				std::vector<uint32_t> recordingIds;
+
+				{
+					DHFS4_1_Progress progress(L"Read descriptor table of partition " + std::to_wstring(partition.id), partition.bootsector.descriptorTableItemcount);
+
+					for (uint32_t i = 0; i < partition.bootsector.descriptorTableItemcount; i++)
+					{
+						if (!progress.update(i))
+						{
+							stopped = true;
+							return;
+						}
+
+						DHFS4_1_Descriptor descriptor;
+						if (readDescriptorTable(reader, partition, i, descriptor))
+						{
+							recordingIds.push_back(i);
+						}
+					}
+				}
+
+				uint64_t failedHeaders = 0;
+				if (!prefetchVideoOffsets(reader, partition, std::move(recordingIds), failedHeaders))
+				{
+					stopped = true;
+					return;
+				}
+
+				// A damaged disk is still carved
+				if (failedHeaders > 0)
+				{
+					fprintf(stderr, "Couldn't read %llu video headers of partition %u\n", (unsigned long long)failedHeaders, unsigned(partition.id));
+				}
+
+				if (carve && (!carveFreeDescriptor(reader, partition) || !carveSlackSpace(reader, partition)))
+				{
+					stopped = true;
+				}
+			});
+	}
+
+	DHFS4_1_Dispatcher dispatcher;
+	dispatcher.run(L"Scan " + std::to_wstring(partitionTable.size()) + L" partitions", workers, getCarveSettings().threadCount);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t totalRecordings = 0;
+	uint64_t totalCarved = 0;
+
+	for (const DHFS4_1_Partition& partition : partitionTable)
+	{
+		printf("Partition %u: %zu recordings, %zu free descriptors, %zu carved streams, %zu cameras\n",
+			partition.id, partition.videoOffsets.size(), partition.freeDescriptors.size(), partition.carvedDescriptors.size(), partition.cameras.size());
+
+		totalRecordings += partition.videoOffsets.size();
+		totalCarved += partition.carvedDescriptors.size();
+	}
+
+	uint64_t bytesRead = mapped ? mappedReader.getBytesRead() : fileReader.getBytesRead();
+
+	printf("%zu partitions, %llu recordings, %llu carved streams\n", partitionTable.size(), (unsigned long long)totalRecordings, (unsigned long long)totalCarved);
+	printf("%llu bytes read in %.3f s, %.1f MB/s, %ls, scanner %ls, %u threads\n", (unsigned long long)bytesRead, seconds,
+		seconds > 0 ? bytesRead / seconds / 1000000 : 0.0, mapped ? L"mmap" : reader.createStreamReader(1)->getName(), getDhavScannerName(), unsigned(getCarveSettings().threadCount));
+
+	if (!mapped)
+	{
+		printf("queue depth %u, %llu read calls, %.1f KB per call\n", unsigned(getQueueDepth()), (unsigned long long)fileReader.getReadCalls(),
+			fileReader.getReadCalls() > 0 ? double(bytesRead) / fileReader.getReadCalls() / 1024 : 0.0);
+	}
+
+	setProgressHost(nullptr);
+
+	if (stopped)
+	{
+		fprintf(stderr, "Scan stopped, the counts are incomplete\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include "pch.h"
+#include "dhfs4_1_dispatcher.h"
+#include "dhfs4_1_progress.h"
+
+static thread_local DHFS4_1_Dispatcher* currentDispatcher = nullptr;
+static thread_local size_t currentWorker = 0;
+static thread_local BOOL workerThread = false;
+
+DHFS4_1_Dispatcher* getDispatcher()
+{
+	return currentDispatcher;
+}
+
+BOOL isWorkerThread()
+{
+	return workerThread;
+}
+
+void callOnHost(const std::function<void()>& task)
+{
+	if (workerThread)
+	{
+		currentDispatcher->call(task);
+	}
+	else
+	{
+		task();
+	}
+}
+
+void DHFS4_1_Dispatcher::call(const std::function<void()>& task)
+{
+	Call call = { &task, currentWorker, false };
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->calls.push_back(&call);
+	this->callPosted.notify_one();
+	this->callDone.wait(lock, [&] { return call.done; });
+}
+
+void DHFS4_1_Dispatcher::setProgress(uint64_t done, uint64_t total)
+{
+	this->progress[currentWorker] = total > 0 ? uint32_t(min(done, total) * 1000 / total) : 1000;
+}
+
+void DHFS4_1_Dispatcher::run(const std::wstring& description, const std::vector<std::function<void()>>& workers, size_t threadCount)
+{
+	this->concurrency = min(threadCount, workers.size());
+
+	if (this->concurrency <= 1)
+	{
+		this->concurrency = 1;
+		for (const std::function<void()>& worker : workers)
+		{
+			worker();
+		}
+		return;
+	}
+
+	this->finishedWorkers = 0;
+	this->progress = std::make_unique<std::atomic<uint32_t>[]>(workers.size());
+
+	std::atomic<size_t> nextWorker = 0;
+	std::vector<std::thread> threads;
+
+	for (size_t t = 0; t < this->concurrency; t++)
+	{
+		threads.emplace_back([&]
+			{
+				workerThread = true;
+				currentDispatcher = this;
+
+				for (size_t i = nextWorker++; i < workers.size(); i = nextWorker++)
+				{
+					currentWorker = i;
+					workers[i]();
+					this->progress[i] = 1000;
+
+					std::lock_guard<std::mutex> lock(this->mutex);
+					this->finishedWorkers++;
+					this->callPosted.notify_one();
+				}
+			});
+	}
+
+	// Created before the calls run, so it's the only progress bar the host shows
+	DHFS4_1_Progress progressBar(description, workers.size() * 1000ULL);
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	while (this->finishedWorkers < workers.size())
+	{
+		this->callPosted.wait_for(lock, std::chrono::milliseconds(DHFS4_1_DISPATCH_INTERVAL),
+			[&] { return !this->calls.empty() || this->finishedWorkers == workers.size(); });
+
+		while (!this->calls.empty())
+		{
+			Call* call = this->calls.front();
+			this->calls.pop_front();
+			lock.unlock();
+
+			// The progress of the call belongs to the worker which posted it
+			currentDispatcher = this;
+			currentWorker = call->worker;
+			(*call->task)();
+			currentDispatcher = nullptr;
+
+			lock.lock();
+			call->done = true;
+			this->callDone.notify_all();
+		}
+
+		lock.unlock();
+
+		uint64_t done = 0;
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			done += this->progress[i];
+		}
+
+		// Also asks the host whether to stop, the workers only read the answer
+		progressBar.update(done);
+
+		lock.lock();
+	}
+
+	lock.unlock();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Runs the partitions of a disk concurrently. The reads (XWF_Read, XWF_SectorIO) run on any thread,
+// the partition and carving workers and the async readers call them directly. Everything else of the
+// X-Tension API, like the item creation and the messages, only runs on the host thread: the workers hand
+// it to the dispatcher and wait until it ran. Their progress goes to one progress bar and the cancellation
+// is asked by the host thread only.
+
+#define DHFS4_1_DISPATCH_INTERVAL 100 // ms the host thread waits for calls before it updates the progress bar
+
+class DHFS4_1_Dispatcher
+{
+private:
+	struct Call {
+		const std::function<void()>* task;
+		size_t worker;
+		BOOL done;
+	};
+
+	std::mutex mutex;
+	std::condition_variable callPosted;
+	std::condition_variable callDone;
+	std::deque<Call*> calls;
+	size_t finishedWorkers = 0;
+	size_t concurrency = 1;
+	std::unique_ptr<std::atomic<uint32_t>[]> progress; // per mille of the current step of each worker
+
+public:
+	// Runs all workers, at most threadCount at once, and runs their calls on the calling thread until all are finished.
+	// With one worker or one thread they just run one after another on the calling thread.
+	void run(const std::wstring& description, const std::vector<std::function<void()>>& workers, size_t threadCount);
+
+	// Workers running at once, they share the carving threads
+	size_t getConcurrency() const
+	{
+		return this->concurrency;
+	}
+
+	// Runs the task on the host thread, the calling worker waits for it
+	void call(const std::function<void()>& task);
+
+	// Progress of the current step of the calling worker
+	void setProgress(uint64_t done, uint64_t total);
+};
+
+// Dispatcher of the worker running on this thread or of the call the host thread is running, nullptr otherwise
+DHFS4_1_Dispatcher* getDispatcher();
+
+// This is a worker thread, so it may only call the reads of the X-Tension API
+BOOL isWorkerThread();
+
+// Runs the task on the host thread, through the dispatcher on a worker thread, directly everywhere else
+void callOnHost(const std::function<void()>& task);
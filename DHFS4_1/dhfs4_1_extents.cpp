@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "dhfs4_1_extents.h"
+
+void DHFS4_1_ExtentMap::append(uint64_t physicalOffset, uint64_t length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	// Recorders mostly write clusters in a row (id, id + 1, ...), so physically
+	// adjacent runs are merged and can be read with a single request
+	if (!this->extents.empty())
+	{
+		DHFS4_1_Extent& last = this->extents.back();
+
+		if (last.physicalOffset + last.length == physicalOffset)
+		{
+			last.length += length;
+			this->size += length;
+			return;
+		}
+	}
+
+	DHFS4_1_Extent extent;
+	extent.logicalOffset = this->size;
+	extent.physicalOffset = physicalOffset;
+	extent.length = length;
+
+	this->extents.push_back(extent);
+	this->size += length;
+}
+
+size_t DHFS4_1_ExtentMap::find(uint64_t offset) const
+{
+	// First extent which starts behind the offset, the one before contains it
+	auto next = std::upper_bound(this->extents.begin(), this->extents.end(), offset,
+		[](uint64_t value, const DHFS4_1_Extent& extent) { return value < extent.logicalOffset; });
+
+	if (next == this->extents.begin() || offset >= this->size)
+	{
+		return this->extents.size();
+	}
+	return (next - this->extents.begin()) - 1;
+}
+
+DHFS4_1_ExtentMap buildRecordingExtents(const DHFS4_1_Partition& partition, const DHFS4_1_Descriptor& descriptor, uint32_t videoOffset)
+{
+	DHFS4_1_ExtentMap extentMap;
+	extentMap.extents.reserve(descriptor.videoFragments.size());
+
+	uint64_t clusterStart = partition.partitionOffset + partition.bootsector.dataAreaOffset;
+	uint64_t skip = videoOffset;
+
+	for (const DHFS4_1_VideoFragment& videoFragment : descriptor.videoFragments)
+	{
+		uint64_t physicalOffset = (clusterStart + partition.bootsector.clusterSize * videoFragment.id) * 512ULL;
+		uint64_t length = videoFragment.fragmentSize * 512ULL;
+
+		// The item starts behind the DHII header of the first cluster
+		uint64_t skipped = min(skip, length);
+		skip -= skipped;
+
+		extentMap.append(physicalOffset + skipped, length - skipped);
+	}
+
+	return extentMap;
+}
+
+DHFS4_1_ExtentMap buildCarvedExtents(const DHFS4_1_Partition& partition, const DHFS4_1_Descriptor& descriptor)
+{
+	DHFS4_1_ExtentMap extentMap;
+	extentMap.extents.reserve(descriptor.videoFragments.size());
+
+	uint64_t clusterStart = partition.partitionOffset + partition.bootsector.dataAreaOffset;
+
+	for (const DHFS4_1_VideoFragment& videoFragment : descriptor.videoFragments)
+	{
+		uint64_t physicalOffset = (clusterStart + partition.bootsector.clusterSize * videoFragment.mainDescriptorId) * 512ULL + videoFragment.offset;
+
+		extentMap.append(physicalOffset, videoFragment.fragmentSize);
+	}
+
+	return extentMap;
+}
+
+std::shared_ptr<const DHFS4_1_ExtentMap> DHFS4_1_ExtentCache::get(LONG nItemID)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	auto found = this->lookup.find(nItemID);
+	if (found == this->lookup.end())
+	{
+		return nullptr;
+	}
+
+	this->entries.splice(this->entries.begin(), this->entries, found->second);
+	return found->second->second;
+}
+
+void DHFS4_1_ExtentCache::put(LONG nItemID, std::shared_ptr<const DHFS4_1_ExtentMap> extentMap)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	auto found = this->lookup.find(nItemID);
+	if (found != this->lookup.end())
+	{
+		this->memoryUsage -= found->second->second->memoryUsage();
+		this->entries.erase(found->second);
+		this->lookup.erase(found);
+	}
+
+	this->memoryUsage += extentMap->memoryUsage();
+	this->entries.emplace_front(nItemID, std::move(extentMap));
+	this->lookup[nItemID] = this->entries.begin();
+
+	evict();
+}
+
+void DHFS4_1_ExtentCache::evict()
+{
+	// The newest map always stays, even if it is bigger than the limit on its own
+	while (this->memoryUsage > this->memoryLimit && this->entries.size() > 1)
+	{
+		Entry& oldest = this->entries.back();
+		this->memoryUsage -= oldest.second->memoryUsage();
+		this->lookup.erase(oldest.first);
+		this->entries.pop_back();
+	}
+}
+
+void DHFS4_1_ExtentCache::clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	this->entries.clear();
+	this->lookup.clear();
+	this->memoryUsage = 0;
+}
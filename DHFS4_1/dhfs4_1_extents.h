@@ -0,0 +1,53 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+
+// One physically contiguous run of an item on the disk, may span several clusters
+struct DHFS4_1_Extent {
+	uint64_t logicalOffset; // offset in the item, prefix sum of all previous lengths
+	uint64_t physicalOffset; // byte offset on the disk
+	uint64_t length;
+};
+
+struct DHFS4_1_ExtentMap {
+	std::vector<DHFS4_1_Extent> extents;
+	uint64_t size = 0;
+
+	void append(uint64_t physicalOffset, uint64_t length);
+
+	// Index of the extent containing the offset, extents.size() if the offset is behind the end
+	size_t find(uint64_t offset) const;
+
+	uint64_t memoryUsage() const
+	{
+		return sizeof(DHFS4_1_ExtentMap) + this->extents.capacity() * sizeof(DHFS4_1_Extent);
+	}
+};
+
+DHFS4_1_ExtentMap buildRecordingExtents(const DHFS4_1_Partition& partition, const DHFS4_1_Descriptor& descriptor, uint32_t videoOffset);
+
+DHFS4_1_ExtentMap buildCarvedExtents(const DHFS4_1_Partition& partition, const DHFS4_1_Descriptor& descriptor);
+
+// LRU cache of extent maps shared by all items, bounded by the memory the maps use
+class DHFS4_1_ExtentCache
+{
+private:
+	typedef std::pair<LONG, std::shared_ptr<const DHFS4_1_ExtentMap>> Entry;
+
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<LONG, std::list<Entry>::iterator> lookup;
+	uint64_t memoryUsage = 0;
+	uint64_t memoryLimit;
+	std::mutex mutex;
+
+	void evict();
+
+public:
+	DHFS4_1_ExtentCache(uint64_t memoryLimit) : memoryLimit(memoryLimit) {}
+
+	std::shared_ptr<const DHFS4_1_ExtentMap> get(LONG nItemID);
+
+	void put(LONG nItemID, std::shared_ptr<const DHFS4_1_ExtentMap> extentMap);
+
+	void clear();
+};
@@ -0,0 +1,309 @@
+#include "pch.h"
+#include "dhfs4_1_filereader.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <climits>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#endif
+
+DHFS4_1_FileReader::~DHFS4_1_FileReader()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+BOOL DHFS4_1_FileReader::open(const char* path, BOOL directStreaming)
+{
+	close();
+
+	this->hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (this->hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(this->hFile, &fileSize);
+	this->size = fileSize.QuadPart;
+
+	if (directStreaming)
+	{
+		this->hDirectFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	}
+	return true;
+}
+
+void DHFS4_1_FileReader::close()
+{
+	if (this->hDirectFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(this->hDirectFile);
+		this->hDirectFile = INVALID_HANDLE_VALUE;
+	}
+	if (this->hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(this->hFile);
+		this->hFile = INVALID_HANDLE_VALUE;
+	}
+	this->size = 0;
+}
+
+BOOL DHFS4_1_FileReader::readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	uint64_t done = 0;
+
+	while (done < length)
+	{
+		// The offset in the OVERLAPPED makes every read independent of the file pointer
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = DWORD(offset + done);
+		overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+
+		DWORD chunk = DWORD(min(length - done, 0x10000000ULL));
+		DWORD read = 0;
+
+		this->counters.calls++;
+		if (!ReadFile(this->hFile, buffer + done, chunk, &read, &overlapped) || read == 0)
+		{
+			break;
+		}
+		done += read;
+	}
+
+	this->counters.bytes += done;
+	ZeroMemory(buffer + done, length - done);
+	return done == length;
+}
+
+BOOL DHFS4_1_FileReader::readVector(std::span<const DHFS4_1_ReadRequest> requests)
+{
+	return DHFS_4_1_ReaderInterface::readVector(requests);
+}
+
+BOOL DHFS4_1_FileReader::readDirectInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	uint64_t done = 0;
+
+	while (done < length)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = DWORD(offset + done);
+		overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+
+		DWORD chunk = DWORD(min(length - done, 0x10000000ULL));
+		DWORD read = 0;
+
+		this->counters.calls++;
+		if (!ReadFile(this->hDirectFile, buffer + done, chunk, &read, &overlapped) || read == 0)
+		{
+			break;
+		}
+		done += read;
+
+		// Only the end of the image gives an unaligned count
+		if (done % DHFS4_1_DIRECT_ALIGNMENT != 0)
+		{
+			break;
+		}
+	}
+
+	this->counters.bytes += done;
+	return done == length || readBytesInto(offset + done, length - done, buffer + done);
+}
+
+#else
+
+BOOL DHFS4_1_FileReader::open(const char* path, BOOL directStreaming)
+{
+	close();
+
+	this->fd = ::open(path, O_RDONLY);
+	if (this->fd < 0)
+	{
+		return false;
+	}
+
+	struct stat status = {};
+	fstat(this->fd, &status);
+	this->size = status.st_size;
+
+#ifdef BLKGETSIZE64
+	// Block devices report no size in stat
+	if (S_ISBLK(status.st_mode))
+	{
+		ioctl(this->fd, BLKGETSIZE64, &this->size);
+	}
+#endif
+
+	// The descriptor table and the clusters are read from front to back
+	posix_fadvise(this->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+#ifdef O_DIRECT
+	// Filesystems without direct I/O (tmpfs) refuse it, the carving reads are cached then
+	if (directStreaming)
+	{
+		this->directFd = ::open(path, O_RDONLY | O_DIRECT);
+	}
+#endif
+	return true;
+}
+
+void DHFS4_1_FileReader::close()
+{
+	if (this->directFd >= 0)
+	{
+		::close(this->directFd);
+		this->directFd = -1;
+	}
+	if (this->fd >= 0)
+	{
+		::close(this->fd);
+		this->fd = -1;
+	}
+	this->size = 0;
+}
+
+BOOL DHFS4_1_FileReader::readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	uint64_t done = 0;
+
+	while (done < length)
+	{
+		this->counters.calls++;
+		ssize_t read = pread(this->fd, buffer + done, length - done, offset + done);
+		if (read <= 0)
+		{
+			break;
+		}
+		done += read;
+	}
+
+	this->counters.bytes += done;
+	ZeroMemory(buffer + done, length - done);
+	return done == length;
+}
+
+BOOL DHFS4_1_FileReader::readVector(std::span<const DHFS4_1_ReadRequest> requests)
+{
+	std::vector<iovec> vectors;
+
+	return forEachReadRun(requests, IOV_MAX, [&](std::span<const DHFS4_1_ReadRequest> run) -> BOOL
+		{
+			if (run.size() == 1)
+			{
+				return readBytesInto(run[0].offset, run[0].length, run[0].destination);
+			}
+
+			uint64_t length = 0;
+			vectors.clear();
+
+			for (const DHFS4_1_ReadRequest& request : run)
+			{
+				vectors.push_back({ request.destination, request.length });
+				length += request.length;
+			}
+
+			this->counters.calls++;
+			ssize_t read = preadv(this->fd, vectors.data(), int(vectors.size()), run[0].offset);
+
+			if (read == ssize_t(length))
+			{
+				this->counters.bytes += length;
+				return true;
+			}
+
+			// Short read, the requests it didn't finish are read one by one, which zeroes behind the end
+			BOOL success = true;
+			uint64_t done = read > 0 ? read : 0;
+			this->counters.bytes += done;
+
+			for (const DHFS4_1_ReadRequest& request : run)
+			{
+				if (done >= request.length)
+				{
+					done -= request.length;
+					continue;
+				}
+
+				success = readBytesInto(request.offset + done, request.length - done, request.destination + done) && success;
+				done = 0;
+			}
+			return success;
+		});
+}
+
+BOOL DHFS4_1_FileReader::readDirectInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	uint64_t done = 0;
+
+	while (done < length)
+	{
+		this->counters.calls++;
+		ssize_t read = pread(this->directFd, buffer + done, length - done, offset + done);
+		if (read <= 0)
+		{
+			break;
+		}
+		done += read;
+
+		// Only the end of the image gives an unaligned count
+		if (done % DHFS4_1_DIRECT_ALIGNMENT != 0)
+		{
+			break;
+		}
+	}
+
+	this->counters.bytes += done;
+	return done == length || readBytesInto(offset + done, length - done, buffer + done);
+}
+
+#endif
+
+std::unique_ptr<DHFS4_1_AsyncReader> DHFS4_1_FileReader::createAsyncReader(size_t queueDepth)
+{
+#ifdef __linux__
+	std::unique_ptr<DHFS4_1_AsyncReader> uringReader = createUringReader(*this, this->fd, this->counters, queueDepth);
+	if (uringReader != nullptr)
+	{
+		return uringReader;
+	}
+#endif
+	return createThreadPoolReader(*this, queueDepth);
+}
+
+std::unique_ptr<DHFS4_1_AsyncReader> DHFS4_1_FileReader::createStreamReader(size_t queueDepth)
+{
+	if (!isDirectStreaming())
+	{
+		return createAsyncReader(queueDepth);
+	}
+
+#ifdef __linux__
+	std::unique_ptr<DHFS4_1_AsyncReader> uringReader = createUringReader(*this, this->directFd, this->counters, queueDepth, DHFS4_1_DIRECT_ALIGNMENT);
+	if (uringReader != nullptr)
+	{
+		return uringReader;
+	}
+#endif
+	return createThreadPoolReader([this](uint64_t offset, uint64_t length, BYTE* buffer) { return readDirectInto(offset, length, buffer); }, queueDepth, DHFS4_1_DIRECT_ALIGNMENT);
+}
+
+DHFS4_1_Buffer DHFS4_1_FileReader::readSectors(uint64_t offset, uint64_t size)
+{
+	DHFS4_1_Buffer buffer = acquireBuffer(size * 512);
+	readSectorsInto(offset, size, buffer.get());
+	return buffer;
+}
+
+BOOL DHFS4_1_FileReader::readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer)
+{
+	return readBytesInto(offset, size * 512, buffer);
+}
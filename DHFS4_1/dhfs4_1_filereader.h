@@ -0,0 +1,77 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+#include "dhfs4_1_asyncreader.h"
+
+#define DHFS4_1_DIRECT_ALIGNMENT 4096 // unbuffered reads, fits drives with 512 byte and 4K sectors
+
+// Reads a raw image (dd) or a block device directly, for the parser core outside of X-Ways.
+// All reads are positional, so the carving threads share one reader.
+// With direct streaming a second handle bypasses the page cache for the stream reads of the carving,
+// every cluster is read once anyway. The random reads of the tables and headers stay cached.
+class DHFS4_1_FileReader : public DHFS_4_1_ReaderInterface
+{
+private:
+#ifdef _WIN32
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hDirectFile = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+	int directFd = -1;
+#endif
+	uint64_t size = 0;
+	DHFS4_1_ReadCounters counters;
+
+	// Aligned read through the direct handle, the unaligned rest behind the end of the image is read cached
+	BOOL readDirectInto(uint64_t offset, uint64_t length, BYTE* buffer);
+
+public:
+	~DHFS4_1_FileReader();
+
+	// Fails if the image can't be opened, without direct I/O support it just stays cached
+	BOOL open(const char* path, BOOL directStreaming = false);
+
+	void close();
+
+	DHFS4_1_Buffer readSectors(uint64_t offset, uint64_t size);
+
+	BOOL readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer);
+
+	// Bytes behind the end of the image are zeroed and the read fails
+	BOOL readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer);
+
+	// Adjacent requests are read with one preadv
+	BOOL readVector(std::span<const DHFS4_1_ReadRequest> requests);
+
+	// io_uring if the kernel offers it, the thread pool otherwise
+	std::unique_ptr<DHFS4_1_AsyncReader> createAsyncReader(size_t queueDepth);
+
+	// The same on the direct handle, aligned to DHFS4_1_DIRECT_ALIGNMENT
+	std::unique_ptr<DHFS4_1_AsyncReader> createStreamReader(size_t queueDepth);
+
+	BOOL isDirectStreaming() const
+	{
+#ifdef _WIN32
+		return this->hDirectFile != INVALID_HANDLE_VALUE;
+#else
+		return this->directFd >= 0;
+#endif
+	}
+
+	uint64_t getSize() const
+	{
+		return this->size;
+	}
+
+	// All bytes read so far, for the throughput
+	uint64_t getBytesRead() const
+	{
+		return this->counters.bytes;
+	}
+
+	// Reads issued to the system so far
+	uint64_t getReadCalls() const
+	{
+		return this->counters.calls;
+	}
+};
@@ -0,0 +1,454 @@
+#include "pch.h"
+#include "dhfs4_1_index.h"
+
+// FNV-1a, good enough to tell images apart, it's no integrity check
+static uint64_t fnv1a(uint64_t hash, const BYTE* data, uint64_t length)
+{
+	for (uint64_t i = 0; i < length; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+uint64_t hashBootSectors(DHFS_4_1_ReaderInterface& reader, const std::vector<DHFS4_1_Partition>& partitionTable)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	// Sector 0 (DHFS signature) and sector 30 (partition table)
+	DHFS4_1_Buffer buffer = reader.readSectors(0, 1);
+	hash = fnv1a(hash, buffer.get(), 512);
+
+	buffer = reader.readSectors(30 * 512ULL, 1);
+	hash = fnv1a(hash, buffer.get(), 512);
+
+	for (const DHFS4_1_Partition& partition : partitionTable)
+	{
+		buffer = reader.readSectors(partition.bootSectorOffset * 512ULL + partition.partitionOffset * 512ULL, 1);
+		hash = fnv1a(hash, buffer.get(), 512);
+	}
+
+	return hash;
+}
+
+std::vector<std::wstring> getIndexPaths(const DHFS4_1_ImageIdentity& identity)
+{
+	std::vector<std::wstring> paths;
+	std::wstring fileName = std::format(L"DHFS4_1_{:016X}_{:016X}.idx", identity.imageSize, identity.bootHash);
+
+	// Prefer the case directory, the temp directory is the fallback if no case is open
+	wchar_t directory[MAX_PATH + 1] = {};
+	if (XWF_GetCaseProp != nullptr && XWF_GetCaseProp(NULL, XWF_CASEPROP_DIR, directory, MAX_PATH) > 0)
+	{
+		std::wstring caseDirectory(directory);
+		if (!caseDirectory.empty() && caseDirectory.back() != L'\\')
+		{
+			caseDirectory += L'\\';
+		}
+		paths.push_back(caseDirectory + fileName);
+	}
+
+	ZeroMemory(directory, sizeof(directory));
+	if (GetTempPathW(MAX_PATH, directory) > 0)
+	{
+		paths.push_back(std::wstring(directory) + fileName);
+	}
+
+	return paths;
+}
+
+void DHFS4_1_IndexWriter::addPartition(const DHFS4_1_Partition& partition)
+{
+	PartitionData data = {};
+	data.header.id = partition.id;
+	data.header.bootSectorOffset = partition.bootSectorOffset;
+	data.header.partitionOffset = partition.partitionOffset;
+	data.header.length = partition.length;
+	data.header.bootsector = partition.bootsector;
+
+	if (this->partitions.size() <= partition.id)
+	{
+		this->partitions.resize(partition.id + 1);
+	}
+	this->partitions[partition.id] = std::move(data);
+}
+
+void DHFS4_1_IndexWriter::addRecording(const DHFS4_1_Partition& partition, const DHFS4_1_Descriptor& descriptor)
+{
+	PartitionData& data = this->partitions[partition.id];
+
+	DHFS4_1_IndexRecording recording = {};
+	recording.descriptorId = static_cast<uint32_t>(descriptor.id);
+	recording.beginDate = descriptor.beginDate;
+	recording.endDate = descriptor.endDate;
+
+	auto videoOffset = partition.videoOffsets.find(recording.descriptorId);
+	if (videoOffset != partition.videoOffsets.end())
+	{
+		recording.videoOffset = videoOffset->second;
+	}
+	else
+	{
+		recording.flags |= DHFS4_1_INDEX_NO_VIDEO_OFFSET;
+	}
+
+	recording.lastFragmentSize = static_cast<uint16_t>(descriptor.lastFragmentSize);
+	recording.camera = descriptor.camera;
+	recording.firstFragment = data.fragments.size();
+	recording.fragmentCount = descriptor.videoFragments.size();
+
+	for (const DHFS4_1_VideoFragment& videoFragment : descriptor.videoFragments)
+	{
+		data.fragments.push_back(static_cast<uint32_t>(videoFragment.id));
+	}
+
+	data.recordings.push_back(recording);
+}
+
+void DHFS4_1_IndexWriter::addCarvedDescriptors(const DHFS4_1_Partition& partition)
+{
+	PartitionData& data = this->partitions[partition.id];
+
+	for (const DHFS4_1_Descriptor& descriptor : partition.carvedDescriptors)
+	{
+		DHFS4_1_IndexCarved carved = {};
+		carved.id = static_cast<uint32_t>(descriptor.id);
+		carved.beginDate = descriptor.beginDate;
+		carved.endDate = descriptor.endDate;
+		carved.camera = descriptor.camera;
+		carved.firstFragment = data.carvedFragments.size();
+		carved.fragmentCount = descriptor.videoFragments.size();
+
+		for (const DHFS4_1_VideoFragment& videoFragment : descriptor.videoFragments)
+		{
+			DHFS4_1_IndexCarvedFragment carvedFragment = {};
+			carvedFragment.mainDescriptorId = videoFragment.mainDescriptorId;
+			carvedFragment.offset = videoFragment.offset;
+			carvedFragment.fragmentSize = videoFragment.fragmentSize;
+			carvedFragment.beginDate = videoFragment.beginDate;
+			carvedFragment.offsetInStream = videoFragment.offsetInStream;
+			data.carvedFragments.push_back(carvedFragment);
+		}
+
+		data.carved.push_back(carved);
+	}
+}
+
+BOOL writeSection(HANDLE hFile, const void* data, uint64_t length)
+{
+	const BYTE* position = static_cast<const BYTE*>(data);
+
+	while (length > 0)
+	{
+		DWORD chunk = static_cast<DWORD>(min(length, 0x10000000ULL));
+		DWORD written = 0;
+		if (!WriteFile(hFile, position, chunk, &written, NULL) || written != chunk)
+		{
+			return false;
+		}
+		position += chunk;
+		length -= chunk;
+	}
+	return true;
+}
+
+BOOL DHFS4_1_IndexWriter::write(const std::wstring& path, const DHFS4_1_ImageIdentity& identity)
+{
+	// Lay out all sections first, every offset is known before anything is written
+	DHFS4_1_IndexHeader header = {};
+	header.magic = DHFS4_1_INDEX_MAGIC;
+	header.version = DHFS4_1_INDEX_VERSION;
+	header.headerSize = sizeof(DHFS4_1_IndexHeader);
+	header.imageSize = identity.imageSize;
+	header.bootHash = identity.bootHash;
+	header.partitionCount = this->partitions.size();
+	header.partitionsOffset = sizeof(DHFS4_1_IndexHeader);
+
+	uint64_t offset = header.partitionsOffset + this->partitions.size() * sizeof(DHFS4_1_IndexPartition);
+
+	for (PartitionData& data : this->partitions)
+	{
+		data.header.recordingCount = data.recordings.size();
+		data.header.recordingsOffset = offset;
+		offset += data.recordings.size() * sizeof(DHFS4_1_IndexRecording);
+
+		data.header.carvedCount = data.carved.size();
+		data.header.carvedOffset = offset;
+		offset += data.carved.size() * sizeof(DHFS4_1_IndexCarved);
+
+		data.header.carvedFragmentCount = data.carvedFragments.size();
+		data.header.carvedFragmentsOffset = offset;
+		offset += data.carvedFragments.size() * sizeof(DHFS4_1_IndexCarvedFragment);
+
+		// uint32_t section last, so the 8 byte aligned sections above stay aligned
+		data.header.fragmentCount = data.fragments.size();
+		data.header.fragmentsOffset = offset;
+		offset += data.fragments.size() * sizeof(uint32_t);
+		offset = (offset + 7) & ~7ULL;
+	}
+	header.fileSize = offset;
+
+	// Written to a temporary file first, a half written index must never be mapped
+	std::wstring temporaryPath = path + L".tmp";
+	HANDLE hFile = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	BOOL success = writeSection(hFile, &header, sizeof(header));
+
+	for (const PartitionData& data : this->partitions)
+	{
+		success = success && writeSection(hFile, &data.header, sizeof(DHFS4_1_IndexPartition));
+	}
+
+	const BYTE padding[8] = {};
+	for (const PartitionData& data : this->partitions)
+	{
+		uint64_t fragmentBytes = data.fragments.size() * sizeof(uint32_t);
+
+		success = success && writeSection(hFile, data.recordings.data(), data.recordings.size() * sizeof(DHFS4_1_IndexRecording));
+		success = success && writeSection(hFile, data.carved.data(), data.carved.size() * sizeof(DHFS4_1_IndexCarved));
+		success = success && writeSection(hFile, data.carvedFragments.data(), data.carvedFragments.size() * sizeof(DHFS4_1_IndexCarvedFragment));
+		success = success && writeSection(hFile, data.fragments.data(), fragmentBytes);
+		success = success && writeSection(hFile, padding, ((fragmentBytes + 7) & ~7ULL) - fragmentBytes);
+	}
+
+	CloseHandle(hFile);
+
+	if (!success || !MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(temporaryPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+DHFS4_1_IndexView::~DHFS4_1_IndexView()
+{
+	unmap();
+}
+
+BOOL DHFS4_1_IndexView::map(const std::wstring& path, const DHFS4_1_ImageIdentity& identity)
+{
+	unmap();
+
+	this->hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (this->hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(this->hFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(DHFS4_1_IndexHeader)))
+	{
+		unmap();
+		return false;
+	}
+
+	this->hMapping = CreateFileMappingW(this->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->hMapping == NULL)
+	{
+		unmap();
+		return false;
+	}
+
+	this->view = static_cast<const BYTE*>(MapViewOfFile(this->hMapping, FILE_MAP_READ, 0, 0, 0));
+	this->size = fileSize.QuadPart;
+
+	const DHFS4_1_IndexHeader* header = section<DHFS4_1_IndexHeader>(0, 1);
+
+	// Anything unexpected means a rescan, never a guess
+	if (header == nullptr ||
+		header->magic != DHFS4_1_INDEX_MAGIC ||
+		header->version != DHFS4_1_INDEX_VERSION ||
+		header->headerSize != sizeof(DHFS4_1_IndexHeader) ||
+		header->fileSize != this->size ||
+		header->imageSize != identity.imageSize ||
+		header->bootHash != identity.bootHash ||
+		section<DHFS4_1_IndexPartition>(header->partitionsOffset, header->partitionCount) == nullptr)
+	{
+		unmap();
+		return false;
+	}
+
+	return true;
+}
+
+void DHFS4_1_IndexView::unmap()
+{
+	if (this->view != nullptr)
+	{
+		UnmapViewOfFile(this->view);
+		this->view = nullptr;
+	}
+	if (this->hMapping != NULL)
+	{
+		CloseHandle(this->hMapping);
+		this->hMapping = NULL;
+	}
+	if (this->hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(this->hFile);
+		this->hFile = INVALID_HANDLE_VALUE;
+	}
+	this->size = 0;
+}
+
+const DHFS4_1_IndexPartition* DHFS4_1_IndexView::getPartition(uint32_t partitionId) const
+{
+	const DHFS4_1_IndexHeader* header = section<DHFS4_1_IndexHeader>(0, 1);
+	if (header == nullptr || partitionId >= header->partitionCount)
+	{
+		return nullptr;
+	}
+	return section<DHFS4_1_IndexPartition>(header->partitionsOffset, header->partitionCount) + partitionId;
+}
+
+BOOL DHFS4_1_IndexView::restorePartitions(std::vector<DHFS4_1_Partition>& partitionTable) const
+{
+	for (DHFS4_1_Partition& partition : partitionTable)
+	{
+		const DHFS4_1_IndexPartition* indexPartition = getPartition(partition.id);
+
+		if (indexPartition == nullptr || indexPartition->partitionOffset != partition.partitionOffset)
+		{
+			return false;
+		}
+
+		const DHFS4_1_IndexCarved* carved = section<DHFS4_1_IndexCarved>(indexPartition->carvedOffset, indexPartition->carvedCount);
+		const DHFS4_1_IndexCarvedFragment* carvedFragments = section<DHFS4_1_IndexCarvedFragment>(indexPartition->carvedFragmentsOffset, indexPartition->carvedFragmentCount);
+
+		if (carved == nullptr || carvedFragments == nullptr)
+		{
+			return false;
+		}
+
+		partition.bootsector = indexPartition->bootsector;
+		partition.carvedDescriptors.clear();
+		partition.carvedDescriptors.reserve(indexPartition->carvedCount);
+
+		for (uint64_t i = 0; i < indexPartition->carvedCount; i++)
+		{
+			if (carved[i].firstFragment + carved[i].fragmentCount > indexPartition->carvedFragmentCount)
+			{
+				return false;
+			}
+
+			DHFS4_1_Descriptor descriptor;
+			descriptor.id = carved[i].id;
+			descriptor.beginDate = carved[i].beginDate;
+			descriptor.endDate = carved[i].endDate;
+			descriptor.camera = static_cast<uint8_t>(carved[i].camera);
+			descriptor.status = DHF4_1_DescriptorStatus::carved;
+			descriptor.videoFragments.reserve(carved[i].fragmentCount);
+
+			for (uint64_t j = 0; j < carved[i].fragmentCount; j++)
+			{
+				const DHFS4_1_IndexCarvedFragment& carvedFragment = carvedFragments[carved[i].firstFragment + j];
+
+				DHFS4_1_VideoFragment videoFragment = {};
+				videoFragment.id = carvedFragment.mainDescriptorId;
+				videoFragment.mainDescriptorId = carvedFragment.mainDescriptorId;
+				videoFragment.offset = carvedFragment.offset;
+				videoFragment.fragmentSize = carvedFragment.fragmentSize;
+				videoFragment.beginDate = carvedFragment.beginDate;
+				videoFragment.offsetInStream = carvedFragment.offsetInStream;
+				videoFragment.status = DHF4_1_DescriptorStatus::carved;
+				descriptor.videoFragments.push_back(videoFragment);
+			}
+
+			partition.carvedDescriptors.push_back(std::move(descriptor));
+		}
+	}
+	return true;
+}
+
+const DHFS4_1_IndexRecording* DHFS4_1_IndexView::getRecording(const DHFS4_1_IndexPartition* indexPartition, uint64_t descriptorId) const
+{
+	const DHFS4_1_IndexRecording* recordings = section<DHFS4_1_IndexRecording>(indexPartition->recordingsOffset, indexPartition->recordingCount);
+	if (recordings == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Recordings are written in descriptor table order
+	const DHFS4_1_IndexRecording* recording = std::lower_bound(recordings, recordings + indexPartition->recordingCount, descriptorId,
+		[](const DHFS4_1_IndexRecording& element, uint64_t id) { return element.descriptorId < id; });
+
+	if (recording == recordings + indexPartition->recordingCount || recording->descriptorId != descriptorId)
+	{
+		return nullptr;
+	}
+	return recording;
+}
+
+BOOL DHFS4_1_IndexView::findRecording(uint32_t partitionId, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor) const
+{
+	const DHFS4_1_IndexPartition* indexPartition = getPartition(partitionId);
+	if (indexPartition == nullptr)
+	{
+		return false;
+	}
+
+	const DHFS4_1_IndexRecording* recording = getRecording(indexPartition, descriptorId);
+	const uint32_t* fragments = section<uint32_t>(indexPartition->fragmentsOffset, indexPartition->fragmentCount);
+	if (recording == nullptr || fragments == nullptr ||
+		recording->firstFragment + recording->fragmentCount > indexPartition->fragmentCount)
+	{
+		return false;
+	}
+
+	descriptor.id = recording->descriptorId;
+	descriptor.beginDate = recording->beginDate;
+	descriptor.endDate = recording->endDate;
+	descriptor.camera = recording->camera;
+	descriptor.lastFragmentSize = recording->lastFragmentSize;
+	descriptor.fragmentCount = static_cast<uint16_t>(recording->fragmentCount);
+	descriptor.status = DHF4_1_DescriptorStatus::used;
+	descriptor.videoFragments.clear();
+	descriptor.videoFragments.reserve(recording->fragmentCount);
+
+	for (uint64_t i = 0; i < recording->fragmentCount; i++)
+	{
+		DHFS4_1_VideoFragment videoFragment = {};
+		videoFragment.id = fragments[recording->firstFragment + i];
+		videoFragment.mainDescriptorId = recording->descriptorId;
+		videoFragment.beginDate = recording->beginDate;
+		videoFragment.endDate = recording->endDate;
+		videoFragment.status = DHF4_1_DescriptorStatus::used;
+
+		// Same rule as in resolveDescriptor: only a following fragment can be shorter than a cluster
+		if (i > 0 && i == recording->fragmentCount - 1)
+		{
+			videoFragment.fragmentSize = recording->lastFragmentSize;
+		}
+		else
+		{
+			videoFragment.fragmentSize = indexPartition->bootsector.clusterSize;
+		}
+		descriptor.videoFragments.push_back(videoFragment);
+	}
+
+	return true;
+}
+
+BOOL DHFS4_1_IndexView::findVideoOffset(uint32_t partitionId, uint64_t descriptorId, uint32_t& videoOffset) const
+{
+	const DHFS4_1_IndexPartition* indexPartition = getPartition(partitionId);
+	if (indexPartition == nullptr)
+	{
+		return false;
+	}
+
+	const DHFS4_1_IndexRecording* recording = getRecording(indexPartition, descriptorId);
+	if (recording == nullptr || (recording->flags & DHFS4_1_INDEX_NO_VIDEO_OFFSET) != 0)
+	{
+		return false;
+	}
+
+	videoOffset = recording->videoOffset;
+	return true;
+}
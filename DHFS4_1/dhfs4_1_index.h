@@ -0,0 +1,152 @@
+#pragma once
+
+#include "dhfs4_1.h"
+
+// Sidecar index written by XT_ProcessItemEx and mapped by XT_SectorIOInit,
+// so the Disk I/O mode doesn't have to scan the whole disk again.
+// All sections are plain arrays of the structs below, referenced by their file offset.
+
+#define DHFS4_1_INDEX_MAGIC 0x3158444953464844ULL // "DHFSIDX1"
+#define DHFS4_1_INDEX_VERSION 2
+
+#define XWF_CASEPROP_DIR 6
+
+#define DHFS4_1_INDEX_NO_VIDEO_OFFSET 0x01 // the DHII header couldn't be read, XT_FileIO reads it again
+
+#pragma pack(push, 8)
+struct DHFS4_1_IndexHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t imageSize;
+	uint64_t bootHash;
+	uint64_t partitionCount;
+	uint64_t partitionsOffset;
+	uint64_t fileSize;
+};
+
+struct DHFS4_1_IndexPartition {
+	uint32_t id;
+	uint32_t bootSectorOffset;
+	uint64_t partitionOffset;
+	uint32_t length;
+	uint32_t reserved;
+	DHFS4_1_Bootsector bootsector;
+	uint64_t recordingCount;
+	uint64_t recordingsOffset;
+	uint64_t fragmentCount;
+	uint64_t fragmentsOffset;
+	uint64_t carvedCount;
+	uint64_t carvedOffset;
+	uint64_t carvedFragmentCount;
+	uint64_t carvedFragmentsOffset;
+};
+
+// Main descriptor of a recording, the fragment ids are stored in the fragments section
+struct DHFS4_1_IndexRecording {
+	uint32_t descriptorId;
+	uint32_t beginDate;
+	uint32_t endDate;
+	uint32_t videoOffset; // from the DHII header, XT_FileIO doesn't need to read it again
+	uint16_t lastFragmentSize;
+	uint8_t camera;
+	uint8_t flags;
+	uint8_t reserved[4];
+	uint64_t firstFragment;
+	uint64_t fragmentCount;
+};
+
+struct DHFS4_1_IndexCarved {
+	uint32_t id;
+	uint32_t beginDate;
+	uint32_t endDate;
+	uint32_t camera;
+	uint64_t firstFragment;
+	uint64_t fragmentCount;
+};
+
+struct DHFS4_1_IndexCarvedFragment {
+	uint32_t mainDescriptorId;
+	uint32_t offset;
+	uint32_t fragmentSize;
+	uint32_t beginDate;
+	uint64_t offsetInStream;
+};
+#pragma pack(pop)
+
+struct DHFS4_1_ImageIdentity {
+	uint64_t imageSize;
+	uint64_t bootHash;
+};
+
+uint64_t hashBootSectors(DHFS_4_1_ReaderInterface& reader, const std::vector<DHFS4_1_Partition>& partitionTable);
+
+std::vector<std::wstring> getIndexPaths(const DHFS4_1_ImageIdentity& identity);
+
+// WriteFile for any length, in chunks a DWORD can hold
+BOOL writeSection(HANDLE hFile, const void* data, uint64_t length);
+
+class DHFS4_1_IndexWriter
+{
+private:
+	struct PartitionData {
+		DHFS4_1_IndexPartition header;
+		std::vector<DHFS4_1_IndexRecording> recordings;
+		std::vector<uint32_t> fragments;
+		std::vector<DHFS4_1_IndexCarved> carved;
+		std::vector<DHFS4_1_IndexCarvedFragment> carvedFragments;
+	};
+
+	std::vector<PartitionData> partitions;
+
+public:
+	void addPartition(const DHFS4_1_Partition& partition);
+
+	void addRecording(const DHFS4_1_Partition& partition, const DHFS4_1_Descriptor& descriptor);
+
+	void addCarvedDescriptors(const DHFS4_1_Partition& partition);
+
+	BOOL write(const std::wstring& path, const DHFS4_1_ImageIdentity& identity);
+};
+
+class DHFS4_1_IndexView
+{
+private:
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hMapping = NULL;
+	const BYTE* view = nullptr;
+	uint64_t size = 0;
+
+	template <typename T>
+	const T* section(uint64_t offset, uint64_t count) const
+	{
+		if (offset > size || count > (size - offset) / sizeof(T))
+		{
+			return nullptr;
+		}
+		return reinterpret_cast<const T*>(view + offset);
+	}
+
+	const DHFS4_1_IndexPartition* getPartition(uint32_t partitionId) const;
+
+	const DHFS4_1_IndexRecording* getRecording(const DHFS4_1_IndexPartition* indexPartition, uint64_t descriptorId) const;
+
+public:
+	~DHFS4_1_IndexView();
+
+	BOOL map(const std::wstring& path, const DHFS4_1_ImageIdentity& identity);
+
+	void unmap();
+
+	BOOL isMapped() const
+	{
+		return this->view != nullptr;
+	}
+
+	BOOL restorePartitions(std::vector<DHFS4_1_Partition>& partitionTable) const;
+
+	BOOL findRecording(uint32_t partitionId, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor) const;
+
+	// False for recordings whose DHII header couldn't be read while the index was written
+	BOOL findVideoOffset(uint32_t partitionId, uint64_t descriptorId, uint32_t& videoOffset) const;
+};
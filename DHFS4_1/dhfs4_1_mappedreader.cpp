@@ -0,0 +1,174 @@
+#include "pch.h"
+#include "dhfs4_1_mappedreader.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#endif
+
+DHFS4_1_MappedReader::~DHFS4_1_MappedReader()
+{
+	unmap();
+}
+
+#ifdef _WIN32
+
+BOOL DHFS4_1_MappedReader::map(const char* path)
+{
+	unmap();
+
+	this->hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (this->hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(this->hFile, &fileSize) || fileSize.QuadPart == 0 || uint64_t(fileSize.QuadPart) > SIZE_MAX)
+	{
+		unmap();
+		return false;
+	}
+
+	this->hMapping = CreateFileMappingW(this->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->hMapping == NULL)
+	{
+		unmap();
+		return false;
+	}
+
+	this->view = static_cast<const BYTE*>(MapViewOfFile(this->hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (this->view == nullptr)
+	{
+		unmap();
+		return false;
+	}
+
+	this->size = fileSize.QuadPart;
+	return true;
+}
+
+void DHFS4_1_MappedReader::unmap()
+{
+	if (this->view != nullptr)
+	{
+		UnmapViewOfFile(this->view);
+		this->view = nullptr;
+	}
+	if (this->hMapping != NULL)
+	{
+		CloseHandle(this->hMapping);
+		this->hMapping = NULL;
+	}
+	if (this->hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(this->hFile);
+		this->hFile = INVALID_HANDLE_VALUE;
+	}
+	this->size = 0;
+}
+
+#else
+
+BOOL DHFS4_1_MappedReader::map(const char* path)
+{
+	unmap();
+
+	this->fd = ::open(path, O_RDONLY);
+	if (this->fd < 0)
+	{
+		return false;
+	}
+
+	struct stat status = {};
+	fstat(this->fd, &status);
+	uint64_t fileSize = status.st_size;
+
+#ifdef BLKGETSIZE64
+	// Block devices report no size in stat
+	if (S_ISBLK(status.st_mode))
+	{
+		ioctl(this->fd, BLKGETSIZE64, &fileSize);
+	}
+#endif
+
+	if (fileSize == 0 || fileSize > SIZE_MAX)
+	{
+		unmap();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, this->fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		unmap();
+		return false;
+	}
+
+	// The table and the clusters of a partition are walked from front to back, so the kernel reads ahead
+	madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+	this->view = static_cast<const BYTE*>(mapping);
+	this->size = fileSize;
+	return true;
+}
+
+void DHFS4_1_MappedReader::unmap()
+{
+	if (this->view != nullptr)
+	{
+		munmap(const_cast<BYTE*>(this->view), this->size);
+		this->view = nullptr;
+	}
+	if (this->fd >= 0)
+	{
+		::close(this->fd);
+		this->fd = -1;
+	}
+	this->size = 0;
+}
+
+#endif
+
+std::span<const std::byte> DHFS4_1_MappedReader::viewBytes(uint64_t offset, uint64_t length)
+{
+	if (this->view == nullptr || offset > this->size || length > this->size - offset)
+	{
+		return {};
+	}
+
+	this->bytesRead += length;
+	return std::span<const std::byte>(reinterpret_cast<const std::byte*>(this->view + offset), length);
+}
+
+BOOL DHFS4_1_MappedReader::readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer)
+{
+	uint64_t available = offset < this->size ? min(length, this->size - offset) : 0;
+
+	if (available > 0)
+	{
+		memcpy(buffer, this->view + offset, available);
+	}
+
+	this->bytesRead += available;
+	ZeroMemory(buffer + available, length - available);
+	return available == length;
+}
+
+DHFS4_1_Buffer DHFS4_1_MappedReader::readSectors(uint64_t offset, uint64_t size)
+{
+	DHFS4_1_Buffer buffer = acquireBuffer(size * 512);
+	readSectorsInto(offset, size, buffer.get());
+	return buffer;
+}
+
+BOOL DHFS4_1_MappedReader::readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer)
+{
+	return readBytesInto(offset, size * 512, buffer);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+
+// Maps a raw image (dd) or a block device read-only into memory. The descriptor table and the carved
+// clusters are viewed in place, so they are parsed straight from the page cache without a copy.
+// Needs a 64 bit build, the whole image is one mapping. A read error of the device ends the process
+// (SIGBUS / in-page error) instead of failing the read, use DHFS4_1_FileReader for damaged media.
+class DHFS4_1_MappedReader : public DHFS_4_1_ReaderInterface
+{
+private:
+#ifdef _WIN32
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hMapping = NULL;
+#else
+	int fd = -1;
+#endif
+	const BYTE* view = nullptr;
+	uint64_t size = 0;
+	std::atomic<uint64_t> bytesRead = 0;
+
+public:
+	~DHFS4_1_MappedReader();
+
+	BOOL map(const char* path);
+
+	void unmap();
+
+	DHFS4_1_Buffer readSectors(uint64_t offset, uint64_t size);
+
+	BOOL readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer);
+
+	// Bytes behind the end of the image are zeroed and the read fails
+	BOOL readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer);
+
+	// Empty if the range doesn't lie completely inside the image
+	std::span<const std::byte> viewBytes(uint64_t offset, uint64_t length);
+
+	uint64_t getSize() const
+	{
+		return this->size;
+	}
+
+	// All bytes read or viewed so far, for the throughput
+	uint64_t getBytesRead() const
+	{
+		return this->bytesRead;
+	}
+};
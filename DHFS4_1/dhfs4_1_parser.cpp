@@ -0,0 +1,638 @@
+#include "pch.h"
+#include "dhfs4_1_parser.h"
+#include "dhfs4_1_carver.h"
+#include "dhfs4_1_scanstate.h"
+#include "dhfs4_1_progress.h"
+#include "dhfs4_1_dispatcher.h"
+#include "dhfs4_1_asyncreader.h"
+
+BOOL DHFS_4_1_ReaderInterface::readVector(std::span<const DHFS4_1_ReadRequest> requests)
+{
+	BOOL success = true;
+
+	for (const DHFS4_1_ReadRequest& request : requests)
+	{
+		success = readBytesInto(request.offset, request.length, request.destination) && success;
+	}
+	return success;
+}
+
+std::unique_ptr<DHFS4_1_AsyncReader> DHFS_4_1_ReaderInterface::createAsyncReader(size_t queueDepth)
+{
+	return createThreadPoolReader(*this, queueDepth);
+}
+
+std::unique_ptr<DHFS4_1_AsyncReader> DHFS_4_1_ReaderInterface::createStreamReader(size_t queueDepth)
+{
+	return createAsyncReader(queueDepth);
+}
+
+BOOL forEachReadRun(std::span<const DHFS4_1_ReadRequest> requests, size_t maxRequests, const std::function<BOOL(std::span<const DHFS4_1_ReadRequest>)>& read)
+{
+	std::vector<DHFS4_1_ReadRequest> sorted(requests.begin(), requests.end());
+	std::stable_sort(sorted.begin(), sorted.end(), [](const DHFS4_1_ReadRequest& a, const DHFS4_1_ReadRequest& b) { return a.offset < b.offset; });
+
+	BOOL success = true;
+	size_t first = 0;
+
+	while (first < sorted.size())
+	{
+		size_t last = first + 1;
+		uint64_t runLength = sorted[first].length;
+
+		while (last < sorted.size() &&
+			last - first < maxRequests &&
+			sorted[last].offset == sorted[last - 1].offset + sorted[last - 1].length &&
+			runLength + sorted[last].length <= DHFS4_1_READ_RUN_SIZE)
+		{
+			runLength += sorted[last].length;
+			last++;
+		}
+
+		success = read(std::span<const DHFS4_1_ReadRequest>(sorted.data() + first, last - first)) && success;
+		first = last;
+	}
+	return success;
+}
+
+std::span<const std::byte> viewOrRead(DHFS_4_1_ReaderInterface& reader, uint64_t offset, uint64_t length, DHFS4_1_Buffer& buffer)
+{
+	std::span<const std::byte> view = reader.viewBytes(offset, length);
+	if (view.size() == length)
+	{
+		return view;
+	}
+
+	buffer = acquireBuffer(length);
+	if (!reader.readBytesInto(offset, length, buffer.get()))
+	{
+		// Pooled buffers still hold the last data, it must not be parsed again
+		ZeroMemory(buffer.get(), length);
+	}
+	return std::span<const std::byte>(reinterpret_cast<const std::byte*>(buffer.get()), length);
+}
+
+void readPartitionTable(DHFS_4_1_ReaderInterface& reader, std::vector<DHFS4_1_Partition>& partitionTable)
+{
+	// Skip 30 sectors
+	uint64_t partitionTableOffset = 30 * 512ULL;
+	uint64_t internalOffset = 0;
+
+	DHFS4_1_Buffer buffer = reader.readSectors(partitionTableOffset, 1);
+	
+	internalOffset += 64;
+
+	uint32_t endSignatur = 0;
+
+	// Every entry is 64 bytes, a sector without the end signature is no DHFS partition table
+	for (uint32_t i = 0; endSignatur != 0x55AA55AA && internalOffset + 64 <= 512; i++)
+	{
+		DHFS4_1_Partition partition;
+
+		partition.id = i;
+
+		internalOffset += 8;
+
+		memcpy(&partition.bootSectorOffset, buffer.get() + internalOffset, 4);
+		internalOffset += 4;
+
+		internalOffset += 24;
+
+		memcpy(&partition.partitionOffset, buffer.get() + internalOffset, 8);
+		internalOffset += 8;
+
+		memcpy(&partition.length, buffer.get() + internalOffset, 4);
+		internalOffset += 4;
+
+		internalOffset += 4;
+
+		memcpy(&endSignatur, buffer.get() + internalOffset, 4);
+		internalOffset += 4;
+
+		internalOffset += 8;
+
+		partitionTable.push_back(partition);
+	}
+}
+
+void readBootSector(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition)
+{
+	DHFS4_1_Bootsector bootSector;
+	uint64_t internalOffset = 0;
+
+	uint64_t bootSectorOffset = partition.bootSectorOffset * 512ULL + partition.partitionOffset * 512ULL;
+	DHFS4_1_Buffer buffer = reader.readSectors(bootSectorOffset, 1);
+
+	internalOffset += 16;
+
+	memcpy(&bootSector.beginTime, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&bootSector.endTime, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	internalOffset += 20;
+
+	memcpy(&bootSector.sectorSize, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&bootSector.clusterSize, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	internalOffset += 16;
+
+	memcpy(&bootSector.descriptorTableOffset, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&bootSector.dataAreaOffset, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&bootSector.descriptorTableItemcount, buffer.get() + internalOffset, 4);
+	internalOffset += 4;
+
+	internalOffset += 168;
+
+	memcpy(&bootSector.logsOffset, buffer.get() + internalOffset, 4);
+
+	partition.bootsector = bootSector;
+}
+
+// Decodes one 32 byte entry of the descriptor table
+static DHFS4_1_DescriptorEntry decodeDescriptorEntry(const BYTE* entryBuffer)
+{
+	DHFS4_1_DescriptorEntry entry;
+	uint64_t internalOffset = 0;
+
+	memcpy(&entry.id, entryBuffer + internalOffset, 1);
+	internalOffset += 1;
+
+	memcpy(&entry.camera, entryBuffer + internalOffset, 1);
+	internalOffset += 1;
+
+	memcpy(&entry.fragmentCount, entryBuffer + internalOffset, 2);
+	internalOffset += 2;
+
+	memcpy(&entry.beginDate, entryBuffer + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&entry.endDate, entryBuffer + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&entry.nextDescriptorId, entryBuffer + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&entry.lastFragmentSize, entryBuffer + internalOffset, 2);
+	internalOffset += 2;
+
+	// Skip 2 unknown bytes
+	internalOffset += 2;
+
+	memcpy(&entry.prevDescriptorId, entryBuffer + internalOffset, 4);
+	internalOffset += 4;
+
+	memcpy(&entry.mainDescriptorId, entryBuffer + internalOffset, 4);
+
+	return entry;
+}
+
+BOOL loadDescriptorTable(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition)
+{
+	// 16384 sectors = 8 MB per read, always a multiple of the 32 byte entries
+	const uint64_t chunkSectors = 16384;
+	const uint64_t itemCount = partition.bootsector.descriptorTableItemcount;
+	const uint64_t tableSectors = (itemCount * 32ULL + 511) / 512;
+	const uint64_t chunkCount = (tableSectors + chunkSectors - 1) / chunkSectors;
+
+	partition.descriptorTable.clear();
+	partition.descriptorTable.reserve(itemCount);
+
+	uint64_t tableStart = (partition.partitionOffset + partition.bootsector.descriptorTableOffset) * 512ULL;
+
+	// The next chunks are read while one is decoded, chunk i uses slot i % queueDepth
+	size_t queueDepth = min(size_t(getQueueDepth()), size_t(DHFS4_1_TABLE_READ_AHEAD));
+	std::vector<std::span<const std::byte>> chunks(queueDepth);
+	std::vector<uint8_t> chunkReady(queueDepth, 0);
+	DHFS4_1_Buffer readBuffer;
+	std::unique_ptr<DHFS4_1_AsyncReader> asyncReader;
+	uint64_t nextChunk = 0;
+
+	for (uint64_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		if (shouldStop())
+		{
+			return false;
+		}
+
+		for (; nextChunk < chunkCount && nextChunk < chunk + queueDepth; nextChunk++)
+		{
+			size_t slot = nextChunk % queueDepth;
+			uint64_t sector = nextChunk * chunkSectors;
+			uint64_t length = min(chunkSectors, tableSectors - sector) * 512ULL;
+
+			// Decoded straight from the mapping if the reader has one
+			chunks[slot] = reader.viewBytes(tableStart + sector * 512ULL, length);
+			if (chunks[slot].size() == length)
+			{
+				chunkReady[slot] = 1;
+				continue;
+			}
+
+			if (asyncReader == nullptr)
+			{
+				readBuffer = acquireBuffer(queueDepth * chunkSectors * 512ULL);
+				asyncReader = reader.createAsyncReader(queueDepth);
+			}
+
+			BYTE* destination = readBuffer.get() + slot * chunkSectors * 512ULL;
+			chunks[slot] = std::span<const std::byte>(reinterpret_cast<const std::byte*>(destination), length);
+			asyncReader->submit({ tableStart + sector * 512ULL, length, destination }, nextChunk);
+		}
+
+		size_t slot = chunk % queueDepth;
+		uint64_t tag;
+		BOOL success;
+
+		// Later chunks may arrive first, they wait in their slots
+		while (!chunkReady[slot])
+		{
+			// Nothing in flight, but the chunk is missing
+			if (asyncReader == nullptr || !asyncReader->wait(tag, success))
+			{
+				return false;
+			}
+			chunkReady[tag % queueDepth] = success ? 1 : 2;
+		}
+
+		// A chunk which couldn't be read ends the table there, zeroed entries would just look like unused descriptors
+		if (chunkReady[slot] == 2)
+		{
+			return false;
+		}
+
+		const BYTE* table = reinterpret_cast<const BYTE*>(chunks[slot].data());
+		uint64_t firstEntry = (chunk * chunkSectors * 512ULL) / 32;
+		uint64_t lastEntry = min(itemCount, firstEntry + chunks[slot].size() / 32);
+
+		for (uint64_t entry = firstEntry; entry < lastEntry; entry++)
+		{
+			partition.descriptorTable.push_back(decodeDescriptorEntry(table + (entry - firstEntry) * 32));
+		}
+
+		chunkReady[slot] = 0;
+	}
+
+	return partition.descriptorTable.size() == itemCount;
+}
+
+BOOL resolveDescriptor(const DHFS4_1_Partition& partition, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor)
+{
+	if (descriptorId >= partition.descriptorTable.size())
+	{
+		return false;
+	}
+
+	const DHFS4_1_DescriptorEntry& entry = partition.descriptorTable[descriptorId];
+
+	if (entry.id != 0x01 || entry.beginDate >= entry.endDate)
+	{
+		return false;
+	}
+
+	descriptor.beginDate = entry.beginDate;
+	descriptor.endDate = entry.endDate;
+	descriptor.fragmentCount = entry.fragmentCount;
+	descriptor.lastFragmentSize = entry.lastFragmentSize;
+	descriptor.id = descriptorId;
+	descriptor.camera = (entry.camera & 0x0F) + 1;
+	descriptor.status = DHF4_1_DescriptorStatus::used;
+	descriptor.videoFragments.clear();
+
+	DHFS4_1_VideoFragment videoFragment;
+	videoFragment.beginDate = entry.beginDate;
+	videoFragment.endDate = entry.endDate;
+	videoFragment.fragmentId = entry.fragmentCount; // When id == 0x02 fragmentCount is the fragment id
+	videoFragment.id = descriptorId;
+	videoFragment.fragmentSize = partition.bootsector.clusterSize;
+	videoFragment.nextFragmentId = entry.nextDescriptorId;
+	videoFragment.prevFragmentId = 0;
+	videoFragment.mainDescriptorId = descriptorId;
+	descriptor.videoFragments.push_back(videoFragment);
+
+	uint32_t nextFragmentId = videoFragment.nextFragmentId;
+
+	// A broken chain must not run outside the table or loop forever
+	while (nextFragmentId != 0 &&
+		nextFragmentId < partition.descriptorTable.size() &&
+		descriptor.videoFragments.size() <= partition.descriptorTable.size())
+	{
+		const DHFS4_1_DescriptorEntry& fragmentEntry = partition.descriptorTable[nextFragmentId];
+
+		DHFS4_1_VideoFragment videoFragment;
+		videoFragment.beginDate = fragmentEntry.beginDate;
+		videoFragment.endDate = fragmentEntry.endDate;
+		videoFragment.fragmentId = fragmentEntry.fragmentCount; // When id == 0x02 fragmentCount is the fragment id
+		videoFragment.id = nextFragmentId;
+		videoFragment.nextFragmentId = fragmentEntry.nextDescriptorId;
+		videoFragment.prevFragmentId = fragmentEntry.prevDescriptorId;
+		videoFragment.mainDescriptorId = fragmentEntry.mainDescriptorId;
+
+		if (videoFragment.nextFragmentId == 0)
+		{
+			videoFragment.fragmentSize = descriptor.lastFragmentSize;
+		}
+		else
+		{
+			videoFragment.fragmentSize = partition.bootsector.clusterSize;
+		}
+
+		descriptor.videoFragments.push_back(videoFragment);
+
+		nextFragmentId = videoFragment.nextFragmentId;
+	}
+
+	return true;
+}
+
+BOOL readDescriptorTable(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor)
+{
+	// The whole table is read once per partition, all lookups afterwards are in memory
+	if (partition.descriptorTable.empty())
+	{
+		loadDescriptorTable(reader, partition);
+	}
+
+	if (descriptorId >= partition.descriptorTable.size())
+	{
+		return false;
+	}
+
+	const DHFS4_1_DescriptorEntry& entry = partition.descriptorTable[descriptorId];
+
+	if (entry.id == 0xFE)
+	{
+		partition.freeDescriptors.push_back(descriptorId);
+	}
+	else if (entry.id == 0x02)
+	{
+		partition.allocatedDescriptors.push_back(descriptorId);
+	}
+	else if (entry.id == 0x01)
+	{
+		if (resolveDescriptor(partition, descriptorId, descriptor))
+		{
+			partition.allocatedDescriptors.push_back(descriptorId);
+			partition.cameras.insert(entry.camera);
+
+			if (descriptor.videoFragments.size() > 1)
+			{
+				partition.lastFragmentDescriptors.push_back({ descriptor.videoFragments.back().id, descriptor.lastFragmentSize });
+			}
+
+			return true;
+		}
+	}
+	return false;
+}
+
+// Carves the jobs and adds the streams to the carved descriptors. With a scan state the merged frames are saved
+// regularly, a rerun continues behind the last saved job or reuses the frames if the phase was finished.
+static BOOL runCarveJobs(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, const std::vector<DHFS4_1_CarveJob>& carveJobs, const std::wstring& progressDescription, DHFS4_1_ScanState* scanState, DHFS4_1_ScanPhase phase)
+{
+	uint64_t clusterBytes = partition.bootsector.clusterSize * 512ULL;
+	std::vector<DHFS4_1_Videoframe> carvedVideoFrames;
+	size_t firstJob = 0;
+
+	DHFS4_1_PartitionCheckpoint* state = scanState != nullptr ? &scanState->getPartition(partition.id) : nullptr;
+	std::vector<DHFS4_1_Videoframe>* savedFrames = nullptr;
+
+	if (state != nullptr)
+	{
+		std::lock_guard<std::recursive_mutex> lock(scanState->getMutex());
+		savedFrames = phase == DHFS4_1_ScanPhase::freeClusters ? &state->freeFrames : &state->slackFrames;
+
+		if (state->phase > phase)
+		{
+			assembleCarvedDescriptors(*savedFrames, partition.carvedDescriptors);
+			return true;
+		}
+
+		if (state->phase == phase)
+		{
+			carvedVideoFrames = *savedFrames;
+			firstJob = min(size_t(state->carveJobsDone), carveJobs.size());
+		}
+		else
+		{
+			state->phase = phase;
+			state->carveJobsDone = 0;
+			savedFrames->clear();
+		}
+	}
+
+	std::vector<DHFS4_1_CarveJob> remainingJobs(carveJobs.begin() + firstJob, carveJobs.end());
+	DHFS4_1_Progress progress(progressDescription, carveJobs.size());
+
+	// Partitions carved at the same time share the threads
+	DHFS4_1_CarveSettings settings = getCarveSettings();
+	if (getDispatcher() != nullptr)
+	{
+		settings.threadCount = max(1u, settings.threadCount / uint32_t(getDispatcher()->getConcurrency()));
+	}
+
+	auto saveCarving = [&](size_t done, BOOL force)
+	{
+		if (state != nullptr && (force || scanState->isDue()))
+		{
+			std::lock_guard<std::recursive_mutex> lock(scanState->getMutex());
+			state->carveJobsDone = firstJob + done;
+			*savedFrames = carvedVideoFrames;
+			scanState->save(true);
+		}
+	};
+
+	size_t merged = 0;
+	BOOL finished = carveClusters(reader, clusterBytes, remainingJobs, settings, carvedVideoFrames, [&](size_t done)
+		{
+			merged = done;
+			saveCarving(done, false);
+			return progress.update(firstJob + done);
+		});
+
+	if (!finished)
+	{
+		saveCarving(merged, true);
+		return false;
+	}
+
+	assembleCarvedDescriptors(carvedVideoFrames, partition.carvedDescriptors);
+
+	if (state != nullptr)
+	{
+		std::lock_guard<std::recursive_mutex> lock(scanState->getMutex());
+		state->phase = DHFS4_1_ScanPhase(uint32_t(phase) + 1);
+		state->carveJobsDone = 0;
+		*savedFrames = std::move(carvedVideoFrames);
+		scanState->save(true);
+	}
+
+	return true;
+}
+
+BOOL carveFreeDescriptor(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_ScanState* scanState)
+{
+	uint64_t clusterStart = partition.partitionOffset + partition.bootsector.dataAreaOffset;
+
+	std::vector<DHFS4_1_CarveJob> carveJobs;
+
+	for (uint32_t& descriptorId : partition.freeDescriptors)
+	{
+		DHFS4_1_CarveJob carveJob;
+		carveJob.descriptorId = descriptorId;
+		carveJob.clusterOffset = (clusterStart + partition.bootsector.clusterSize * descriptorId) * 512ULL;
+		carveJob.slackStart = 0;
+
+		carveJobs.push_back(carveJob);
+	}
+
+	return runCarveJobs(reader, partition, carveJobs, L"Carve descriptor table of partition " + std::to_wstring(partition.id), scanState, DHFS4_1_ScanPhase::freeClusters);
+}
+
+BOOL carveSlackSpace(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_ScanState* scanState)
+{
+	uint64_t clusterStart = partition.partitionOffset + partition.bootsector.dataAreaOffset;
+
+	std::vector<DHFS4_1_CarveJob> carveJobs;
+
+	for (const auto& lastFragment : partition.lastFragmentDescriptors)
+	{
+		uint64_t descriptorId = lastFragment.first;
+		uint64_t size = lastFragment.second;
+
+		// Last fragment fills the whole cluster, no slack to carve
+		if (size >= partition.bootsector.clusterSize)
+		{
+			continue;
+		}
+
+		// Only the slack behind the last fragment is read, offsets stay relative to the cluster start
+		DHFS4_1_CarveJob carveJob;
+		carveJob.descriptorId = descriptorId;
+		carveJob.clusterOffset = (clusterStart + partition.bootsector.clusterSize * descriptorId) * 512ULL;
+		carveJob.slackStart = size * 512;
+
+		carveJobs.push_back(carveJob);
+	}
+
+	return runCarveJobs(reader, partition, carveJobs, L"Carve slack space of partition " + std::to_wstring(partition.id), scanState, DHFS4_1_ScanPhase::slackSpace);
+}
+
+// Calculating "real" offset by parsing the header of the DHII structure of the .DAV videofiles
+// Skip 64 bytes and read the next 4 byte to get the offset of the first videoframe
+// Without the calculation the video is still playable but not controlable by the timeline of the videoplayer
+static uint64_t getVideoOffsetPosition(const DHFS4_1_Partition& partition, uint32_t descriptorId)
+{
+	uint64_t headerOffset = (partition.partitionOffset + partition.bootsector.dataAreaOffset + static_cast<uint64_t>(partition.bootsector.clusterSize) * descriptorId) * 512ULL;
+	uint64_t internalOffset = 64;
+
+	return headerOffset + internalOffset;
+}
+
+uint32_t readVideoOffset(DHFS_4_1_ReaderInterface& reader, const DHFS4_1_Partition& partition, uint32_t descriptorId)
+{
+	uint32_t videoOffset = 0;
+
+	DHFS4_1_Buffer buffer;
+	memcpy(&videoOffset, viewOrRead(reader, getVideoOffsetPosition(partition, descriptorId), 4, buffer).data(), 4);
+	return videoOffset;
+}
+
+BOOL readVideoOffsets(DHFS_4_1_ReaderInterface& reader, const DHFS4_1_Partition& partition, std::span<const uint32_t> descriptorIds, std::unique_ptr<DHFS4_1_AsyncReader>& asyncReader,
+	std::vector<uint32_t>& videoOffsets, std::vector<uint8_t>& failedReads, const std::function<BOOL(size_t)>& progress)
+{
+	videoOffsets.assign(descriptorIds.size(), 0);
+	failedReads.assign(descriptorIds.size(), 0);
+
+	// Thousands of 4 byte reads one cluster apart, they are kept in flight instead of waiting for each
+	size_t queueDepth = getQueueDepth();
+	size_t submitted = 0;
+	size_t done = 0;
+
+	while (done < descriptorIds.size())
+	{
+		if (progress && !progress(done))
+		{
+			// The reads in flight still write into videoOffsets
+			uint64_t tag;
+			BOOL success;
+			while (asyncReader != nullptr && asyncReader->wait(tag, success))
+			{
+			}
+			return false;
+		}
+
+		for (; submitted < descriptorIds.size() && (asyncReader == nullptr || asyncReader->getInFlight() < queueDepth); submitted++)
+		{
+			uint64_t position = getVideoOffsetPosition(partition, descriptorIds[submitted]);
+
+			std::span<const std::byte> view = reader.viewBytes(position, 4);
+			if (view.size() == 4)
+			{
+				memcpy(&videoOffsets[submitted], view.data(), 4);
+				done++;
+				continue;
+			}
+
+			if (asyncReader == nullptr)
+			{
+				asyncReader = reader.createAsyncReader(queueDepth);
+			}
+			asyncReader->submit({ position, 4, reinterpret_cast<BYTE*>(&videoOffsets[submitted]) }, submitted);
+		}
+
+		uint64_t tag;
+		BOOL success;
+
+		if (asyncReader != nullptr && asyncReader->wait(tag, success))
+		{
+			failedReads[tag] = !success;
+			done++;
+		}
+	}
+	return true;
+}
+
+BOOL prefetchVideoOffsets(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, std::vector<uint32_t> descriptorIds, uint64_t& failedHeaders)
+{
+	failedHeaders = 0;
+
+	// The header sits at the start of the first cluster, so sorting by id is sorting by disk offset
+	std::sort(descriptorIds.begin(), descriptorIds.end());
+	descriptorIds.erase(std::unique(descriptorIds.begin(), descriptorIds.end()), descriptorIds.end());
+
+	std::erase_if(descriptorIds, [&](uint32_t descriptorId) { return partition.videoOffsets.find(descriptorId) != partition.videoOffsets.end(); });
+
+	partition.videoOffsets.reserve(partition.videoOffsets.size() + descriptorIds.size());
+
+	DHFS4_1_Progress progress(L"Read video headers of partition " + std::to_wstring(partition.id), descriptorIds.size());
+
+	std::unique_ptr<DHFS4_1_AsyncReader> asyncReader;
+	std::vector<uint32_t> videoOffsets;
+	std::vector<uint8_t> failedReads;
+
+	if (!readVideoOffsets(reader, partition, descriptorIds, asyncReader, videoOffsets, failedReads, [&](size_t done) { return progress.update(done); }))
+	{
+		return false;
+	}
+
+	// A header which couldn't be read is left out, getVideoOffset reads it again instead of keeping a wrong offset
+	for (size_t i = 0; i < descriptorIds.size(); i++)
+	{
+		if (failedReads[i])
+		{
+			failedHeaders++;
+			continue;
+		}
+		partition.videoOffsets.emplace(descriptorIds[i], videoOffsets[i]);
+	}
+	return true;
+}
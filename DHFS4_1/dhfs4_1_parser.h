@@ -0,0 +1,177 @@
+#pragma once
+
+#include "dhfs4_1_buffers.h"
+#include "dhfs4_1_time.h"
+
+// Parser core of the DHFS4.1 filesystem. It only reads through DHFS_4_1_ReaderInterface and reports
+// through the progress interface, so it runs in the X-Tension as well as in the command line tool.
+
+// One piece of a vectored read, length bytes at the byte offset on the disk into destination
+struct DHFS4_1_ReadRequest {
+	uint64_t offset;
+	uint64_t length;
+	BYTE* destination;
+};
+
+class DHFS4_1_AsyncReader;
+
+class DHFS_4_1_ReaderInterface {
+public:
+	virtual DHFS4_1_Buffer readSectors(uint64_t offset, uint64_t size) = 0;
+
+	// Reads straight into the caller's buffer, which must hold size * 512 bytes
+	virtual BOOL readSectorsInto(uint64_t offset, uint64_t size, BYTE* buffer) = 0;
+
+	// Reads exactly the given byte range, offset doesn't need to be sector aligned
+	virtual BOOL readBytesInto(uint64_t offset, uint64_t length, BYTE* buffer) = 0;
+
+	// Read-only view of the byte range straight into the image, valid as long as the reader.
+	// Empty if the reader can't map the range, the caller reads a copy then, see viewOrRead.
+	virtual std::span<const std::byte> viewBytes([[maybe_unused]] uint64_t offset, [[maybe_unused]] uint64_t length)
+	{
+		return {};
+	}
+
+	// Reads all requests, the reader may sort and merge them into fewer reads of the device.
+	// Returns false if any of them failed. Without an override every request is its own readBytesInto.
+	virtual BOOL readVector(std::span<const DHFS4_1_ReadRequest> requests);
+
+	// Reads with up to queueDepth requests in flight, see dhfs4_1_asyncreader.h.
+	// Without an override readBytesInto runs on a thread pool.
+	virtual std::unique_ptr<DHFS4_1_AsyncReader> createAsyncReader(size_t queueDepth);
+
+	// Reads for scans which touch every byte once, like the carving. A reader may bypass its cache here,
+	// so the requests have to follow getAlignment() of the result. Without an override it's createAsyncReader.
+	virtual std::unique_ptr<DHFS4_1_AsyncReader> createStreamReader(size_t queueDepth);
+};
+
+#define DHFS4_1_READ_RUN_SIZE (16ULL * 1024 * 1024) // bytes merged into one read at most
+#define DHFS4_1_TABLE_READ_AHEAD 4 // 8 MB chunks of the descriptor table in flight at most
+
+// Sorts the requests by offset and calls read for every run of physically adjacent requests,
+// a run holds at most maxRequests requests and DHFS4_1_READ_RUN_SIZE bytes. Returns false if any read failed.
+BOOL forEachReadRun(std::span<const DHFS4_1_ReadRequest> requests, size_t maxRequests, const std::function<BOOL(std::span<const DHFS4_1_ReadRequest>)>& read);
+
+enum class DHF4_1_DescriptorStatus {
+	free = 0,
+	used = 1,
+	unused = 2,
+	dirty = 3,
+	carved = 4,
+	fragCarved = 5
+};
+
+
+struct DHFS4_1_Bootsector {
+	uint32_t beginTime;
+	uint32_t endTime;
+	uint32_t sectorSize;
+	uint32_t clusterSize;
+	uint32_t descriptorTableOffset;
+	uint32_t descriptorTableItemcount;
+	uint32_t dataAreaOffset;
+	uint32_t logsOffset;
+};
+
+struct DHFS4_1_VideoFragment {
+	uint64_t id;
+	uint32_t prevFragmentId;
+	uint32_t nextFragmentId;
+	uint16_t fragmentId;
+	uint32_t beginDate;
+	uint32_t endDate;
+	uint32_t fragmentSize;
+	uint32_t mainDescriptorId;
+	
+	DHF4_1_DescriptorStatus status;
+	uint32_t offset;
+
+	// For carved fragments
+	uint32_t dueBytes;
+	uint64_t offsetInStream;
+};
+
+struct DHFS4_1_Videoframe {
+	uint32_t mainDescriptorId;
+	uint32_t videoOffset;
+	uint16_t camera;
+	uint32_t beginDate;
+	uint32_t length;
+	uint32_t bytesDue;
+	DHF4_1_DescriptorStatus status;
+};
+
+struct DHFS4_1_Descriptor {
+	uint64_t id = 0;
+	uint8_t camera = 0;
+	uint16_t fragmentCount = 0;
+	uint32_t lastFragmentSize = 0;
+	uint32_t beginDate = 0;
+	uint32_t endDate = 0;
+	std::vector<DHFS4_1_VideoFragment> videoFragments;
+	DHF4_1_DescriptorStatus status = DHF4_1_DescriptorStatus::free;
+};
+
+// Decoded 32 byte entry of the descriptor table
+struct DHFS4_1_DescriptorEntry {
+	uint8_t id;
+	uint8_t camera;
+	uint16_t fragmentCount;
+	uint32_t beginDate;
+	uint32_t endDate;
+	uint32_t nextDescriptorId;
+	uint16_t lastFragmentSize;
+	uint32_t prevDescriptorId;
+	uint32_t mainDescriptorId;
+};
+
+struct DHFS4_1_Partition {
+	uint32_t id;
+	uint32_t bootSectorOffset;
+	uint64_t partitionOffset;
+	uint32_t length;
+	std::set<uint16_t> cameras;
+	DHFS4_1_Bootsector bootsector;
+	std::unordered_map<uint32_t, DHFS4_1_Descriptor> mainDescriptors;
+	std::vector<DHFS4_1_Descriptor> carvedDescriptors;
+	std::vector<uint32_t> allocatedDescriptors;
+	std::vector<uint32_t> freeDescriptors;
+	std::vector<std::pair<uint64_t, uint64_t>> lastFragmentDescriptors;
+	std::vector<DHFS4_1_DescriptorEntry> descriptorTable;
+	std::unordered_map<uint32_t, uint32_t> videoOffsets; // offset of the first videoframe of each recording
+	uint64_t rootId;
+	uint64_t carvedRootId;
+};
+
+class DHFS4_1_ScanState;
+
+// The reader's view of the byte range, or a copy of it in buffer if the reader can't map it
+std::span<const std::byte> viewOrRead(DHFS_4_1_ReaderInterface& reader, uint64_t offset, uint64_t length, DHFS4_1_Buffer& buffer);
+
+void readPartitionTable(DHFS_4_1_ReaderInterface& reader, std::vector<DHFS4_1_Partition>& partitionTable);
+
+void readBootSector(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition);
+
+// Returns false if it was stopped or a part of the table couldn't be read, the table only has the entries before it then
+BOOL loadDescriptorTable(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition);
+
+BOOL resolveDescriptor(const DHFS4_1_Partition& partition, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor);
+
+BOOL readDescriptorTable(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, uint64_t descriptorId, DHFS4_1_Descriptor& descriptor);
+
+BOOL carveFreeDescriptor(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_ScanState* scanState = nullptr);
+
+BOOL carveSlackSpace(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, DHFS4_1_ScanState* scanState = nullptr);
+
+// Offset of the first videoframe behind the DHII header of a recording
+uint32_t readVideoOffset(DHFS_4_1_ReaderInterface& reader, const DHFS4_1_Partition& partition, uint32_t descriptorId);
+
+// Reads the DHII headers of the descriptors with the reads in flight, the ids should be in disk order.
+// failedReads is set for the headers which couldn't be read. The async reader is created on the first read
+// which isn't mapped, the caller keeps it for the next call. Returns false if progress asked to stop.
+BOOL readVideoOffsets(DHFS_4_1_ReaderInterface& reader, const DHFS4_1_Partition& partition, std::span<const uint32_t> descriptorIds, std::unique_ptr<DHFS4_1_AsyncReader>& asyncReader,
+	std::vector<uint32_t>& videoOffsets, std::vector<uint8_t>& failedReads, const std::function<BOOL(size_t)>& progress);
+
+// Reads the DHII headers of the recordings in disk order and keeps their video offsets in the partition.
+// Headers which couldn't be read are counted in failedHeaders and left out. Returns false if it was stopped.
+BOOL prefetchVideoOffsets(DHFS_4_1_ReaderInterface& reader, DHFS4_1_Partition& partition, std::vector<uint32_t> descriptorIds, uint64_t& failedHeaders);
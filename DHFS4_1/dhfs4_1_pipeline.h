@@ -0,0 +1,106 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+
+// Bounded queue between a background stage and the host thread. The producer blocks while it's full,
+// so the decoding never runs far ahead of the item creation and the memory stays small.
+
+#define DHFS4_1_PIPELINE_BATCH 256 // recordings per batch
+#define DHFS4_1_PIPELINE_DEPTH 8 // batches in the queue
+
+// Resolved recordings and the video offsets from their DHII headers, ready for createVSItems
+struct DHFS4_1_RecordingBatch {
+	std::vector<DHFS4_1_Descriptor> descriptors;
+	std::vector<uint32_t> videoOffsets;
+	std::vector<uint8_t> failedReads; // headers which couldn't be read, their offsets aren't kept
+};
+
+struct DHFS4_1_QueueStats {
+	uint64_t batches = 0;
+	uint64_t depthSum = 0; // batches waiting at every pop, including the popped one
+	size_t maxDepth = 0;
+	std::chrono::nanoseconds producerWait{ 0 }; // waiting for a free slot
+	std::chrono::nanoseconds consumerWait{ 0 }; // waiting for a batch
+};
+
+template <typename T>
+class DHFS4_1_BoundedQueue
+{
+private:
+	std::deque<T> items;
+	size_t capacity;
+	BOOL closed = false;
+	BOOL cancelled = false;
+	DHFS4_1_QueueStats stats;
+	std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+
+public:
+	DHFS4_1_BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+	// Blocks while the queue is full, returns false if the consumer cancelled
+	BOOL push(T item)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->notFull.wait(lock, [&] { return this->items.size() < this->capacity || this->cancelled; });
+		this->stats.producerWait += std::chrono::steady_clock::now() - start;
+
+		if (this->cancelled)
+		{
+			return false;
+		}
+
+		this->items.push_back(std::move(item));
+		this->stats.maxDepth = max(this->stats.maxDepth, this->items.size());
+		this->notEmpty.notify_one();
+		return true;
+	}
+
+	// Blocks until there is an item, returns false once the queue is closed and empty
+	BOOL pop(T& item)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->notEmpty.wait(lock, [&] { return !this->items.empty() || this->closed; });
+		this->stats.consumerWait += std::chrono::steady_clock::now() - start;
+
+		if (this->items.empty())
+		{
+			return false;
+		}
+
+		this->stats.batches++;
+		this->stats.depthSum += this->items.size();
+
+		item = std::move(this->items.front());
+		this->items.pop_front();
+		this->notFull.notify_one();
+		return true;
+	}
+
+	// Called by the producer after its last item
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->closed = true;
+		this->notEmpty.notify_all();
+	}
+
+	// Called by the consumer when it stops early, a waiting producer returns
+	void cancel()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->cancelled = true;
+		this->notFull.notify_all();
+	}
+
+	DHFS4_1_QueueStats getStats()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->stats;
+	}
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+// The Win32 types and calls the parser core uses, for builds without windows.h.
+// Included by pch.h after the standard headers, so min and max don't break them.
+
+#ifndef _WIN32
+
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int64_t INT64;
+typedef void* HANDLE;
+typedef void* LPVOID;
+
+#define ZeroMemory(destination, length) memset((destination), 0, (length))
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+// Returns the length without the terminating zero, 0 if the variable doesn't exist or doesn't fit
+inline DWORD GetEnvironmentVariableW(const wchar_t* name, wchar_t* buffer, DWORD size)
+{
+	char narrowName[256];
+	if (wcstombs(narrowName, name, sizeof(narrowName)) >= sizeof(narrowName))
+	{
+		return 0;
+	}
+
+	const char* value = getenv(narrowName);
+	if (value == nullptr)
+	{
+		return 0;
+	}
+
+	size_t length = mbstowcs(buffer, value, size);
+	return length < size ? DWORD(length) : 0;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "dhfs4_1_progress.h"
+#include "dhfs4_1_dispatcher.h"
+
+static DHFS4_1_ProgressHost* progressHost = nullptr;
+static std::atomic<int64_t> lastStopCheck = INT64_MIN / 2;
+static std::atomic<BOOL> lastStopAnswer = false;
+
+void setProgressHost(DHFS4_1_ProgressHost* host)
+{
+	progressHost = host;
+}
+
+static int64_t getMilliseconds()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BOOL shouldStop()
+{
+	// The host thread of the dispatcher keeps asking for the workers
+	if (isWorkerThread())
+	{
+		return lastStopAnswer;
+	}
+
+	int64_t now = getMilliseconds();
+	int64_t lastCheck = lastStopCheck.load();
+
+	// Only the thread which moves the timestamp forward asks the host
+	if (now - lastCheck >= DHFS4_1_STOP_INTERVAL && lastStopCheck.compare_exchange_strong(lastCheck, now))
+	{
+		lastStopAnswer = progressHost != nullptr && progressHost->shouldStop();
+	}
+
+	return lastStopAnswer;
+}
+
+void resetStop()
+{
+	lastStopCheck = INT64_MIN / 2;
+	lastStopAnswer = false;
+}
+
+DHFS4_1_Progress::DHFS4_1_Progress(const std::wstring& description, uint64_t total) : total(total)
+{
+	this->lastUpdate = std::chrono::steady_clock::now();
+
+	// Steps of a partition worker only count towards the progress bar of the dispatcher
+	if (getDispatcher() != nullptr || progressHost == nullptr)
+	{
+		return;
+	}
+
+	progressHost->showProgress(description);
+	progressHost->setProgressPercentage(0);
+}
+
+DHFS4_1_Progress::~DHFS4_1_Progress()
+{
+	if (getDispatcher() == nullptr && progressHost != nullptr)
+	{
+		progressHost->hideProgress();
+	}
+}
+
+BOOL DHFS4_1_Progress::update(uint64_t done)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (now - this->lastUpdate >= std::chrono::milliseconds(DHFS4_1_PROGRESS_INTERVAL))
+	{
+		if (getDispatcher() != nullptr)
+		{
+			getDispatcher()->setProgress(done, this->total);
+			this->lastUpdate = now;
+			return !shouldStop();
+		}
+
+		DWORD newPercent = this->total > 0 ? DWORD((100. / this->total) * done) : 100;
+
+		if (newPercent != this->percent && progressHost != nullptr)
+		{
+			progressHost->setProgressPercentage(newPercent);
+			this->percent = newPercent;
+		}
+
+		this->lastUpdate = now;
+	}
+
+	return !shouldStop();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Progress bar and cancellation for the long loops. Asking the host for every descriptor
+// costs millions of calls per partition, so both are throttled by time.
+
+#define DHFS4_1_PROGRESS_INTERVAL 250 // ms between progress bar updates
+#define DHFS4_1_STOP_INTERVAL 100 // ms between the stop questions to the host
+
+// Progress bar and stop button of the host. The X-Tension forwards them to X-Ways,
+// without a host nothing is shown and nothing stops.
+class DHFS4_1_ProgressHost
+{
+public:
+	virtual void showProgress(const std::wstring& description) = 0;
+
+	virtual void setProgressPercentage(DWORD percent) = 0;
+
+	virtual void hideProgress() = 0;
+
+	virtual BOOL shouldStop() = 0;
+};
+
+// Set once before the first scan, nullptr removes the host
+void setProgressHost(DHFS4_1_ProgressHost* host);
+
+// The host's shouldStop, but the host is asked at most every DHFS4_1_STOP_INTERVAL ms, the answer is kept in between.
+// Safe to call from any thread, partition workers only get the answer the dispatcher's host thread got.
+BOOL shouldStop();
+
+// Forgets the last answer, called when a new operation starts
+void resetStop();
+
+// Shows the progress bar until it's destroyed
+class DHFS4_1_Progress
+{
+private:
+	uint64_t total;
+	DWORD percent = 0;
+	std::chrono::steady_clock::time_point lastUpdate;
+
+public:
+	DHFS4_1_Progress(const std::wstring& description, uint64_t total);
+
+	~DHFS4_1_Progress();
+
+	// done of total are finished, returns false when the user wants to stop
+	BOOL update(uint64_t done);
+};
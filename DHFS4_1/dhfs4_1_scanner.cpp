@@ -0,0 +1,190 @@
+#include "pch.h"
+#include "dhfs4_1_scanner.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DHFS4_1_SCANNER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions marked for it, MSVC always does
+#if defined(__GNUC__)
+#define DHFS4_1_TARGET_AVX2 __attribute__((target("avx2")))
+#define DHFS4_1_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define DHFS4_1_TARGET_AVX2
+#define DHFS4_1_TARGET_SSE2
+#endif
+
+typedef void (*DHFS4_1_ScanFunction)(const BYTE* buffer, uint64_t position, uint64_t length, std::vector<DHFS4_1_SignatureHit>& hits);
+
+static const BYTE dhavSignaturBegin[4] = { 0x44, 0x48, 0x41, 0x56 };
+static const BYTE dhavSignaturEnd[4] = { 0x64, 0x68, 0x61, 0x76 };
+
+// The vector loops match case-insensitive, so "DHAV" and "dhav" are found in one pass. Mixed case is sorted out here.
+static inline void addHit(const BYTE* buffer, uint64_t position, std::vector<DHFS4_1_SignatureHit>& hits)
+{
+	if (std::memcmp(buffer + position, dhavSignaturBegin, 4) == 0)
+	{
+		hits.push_back({ static_cast<uint32_t>(position), DHFS4_1_SignatureType::header });
+	}
+	else if (std::memcmp(buffer + position, dhavSignaturEnd, 4) == 0)
+	{
+		hits.push_back({ static_cast<uint32_t>(position), DHFS4_1_SignatureType::footer });
+	}
+}
+
+static void scanScalar(const BYTE* buffer, uint64_t position, uint64_t length, std::vector<DHFS4_1_SignatureHit>& hits)
+{
+	for (; position + 4 <= length; position++)
+	{
+		if ((buffer[position] | 0x20) == 0x64)
+		{
+			addHit(buffer, position, hits);
+		}
+	}
+}
+
+#ifdef DHFS4_1_SCANNER_X86
+
+DHFS4_1_TARGET_SSE2 static void scanSse2(const BYTE* buffer, uint64_t position, uint64_t length, std::vector<DHFS4_1_SignatureHit>& hits)
+{
+	const __m128i caseBit = _mm_set1_epi8(0x20);
+	const __m128i d = _mm_set1_epi8(0x64);
+	const __m128i h = _mm_set1_epi8(0x68);
+	const __m128i a = _mm_set1_epi8(0x61);
+	const __m128i v = _mm_set1_epi8(0x76);
+
+	// The last load starts 3 bytes behind the block, so it has to fit into the buffer too
+	for (; position + 16 + 3 <= length; position += 16)
+	{
+		__m128i b0 = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + position)), caseBit);
+		__m128i b1 = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + position + 1)), caseBit);
+		__m128i b2 = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + position + 2)), caseBit);
+		__m128i b3 = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + position + 3)), caseBit);
+
+		__m128i match = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(b0, d), _mm_cmpeq_epi8(b1, h)),
+			_mm_and_si128(_mm_cmpeq_epi8(b2, a), _mm_cmpeq_epi8(b3, v)));
+
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(match));
+
+		while (mask != 0)
+		{
+			addHit(buffer, position + std::countr_zero(mask), hits);
+			mask &= mask - 1;
+		}
+	}
+
+	scanScalar(buffer, position, length, hits);
+}
+
+DHFS4_1_TARGET_AVX2 static void scanAvx2(const BYTE* buffer, uint64_t position, uint64_t length, std::vector<DHFS4_1_SignatureHit>& hits)
+{
+	const __m256i caseBit = _mm256_set1_epi8(0x20);
+	const __m256i d = _mm256_set1_epi8(0x64);
+	const __m256i h = _mm256_set1_epi8(0x68);
+	const __m256i a = _mm256_set1_epi8(0x61);
+	const __m256i v = _mm256_set1_epi8(0x76);
+
+	for (; position + 32 + 3 <= length; position += 32)
+	{
+		__m256i b0 = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer + position)), caseBit);
+		__m256i b1 = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer + position + 1)), caseBit);
+		__m256i b2 = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer + position + 2)), caseBit);
+		__m256i b3 = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer + position + 3)), caseBit);
+
+		__m256i match = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpeq_epi8(b0, d), _mm256_cmpeq_epi8(b1, h)),
+			_mm256_and_si256(_mm256_cmpeq_epi8(b2, a), _mm256_cmpeq_epi8(b3, v)));
+
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(match));
+
+		while (mask != 0)
+		{
+			addHit(buffer, position + std::countr_zero(mask), hits);
+			mask &= mask - 1;
+		}
+	}
+
+	scanSse2(buffer, position, length, hits);
+}
+
+static BOOL cpuSupportsAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+
+	// AVX2 needs the CPU flag and the OS saving the YMM registers
+	__cpuid(info, 1);
+	BOOL osxsave = (info[2] & (1 << 27)) != 0;
+	BOOL avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x06) != 0x06)
+	{
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static BOOL cpuSupportsSse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+struct DHFS4_1_Scanner {
+	DHFS4_1_ScanFunction scan;
+	const wchar_t* name;
+};
+
+static DHFS4_1_Scanner selectScanner()
+{
+#ifdef DHFS4_1_SCANNER_X86
+	if (cpuSupportsAvx2())
+	{
+		return { scanAvx2, L"AVX2" };
+	}
+	if (cpuSupportsSse2())
+	{
+		return { scanSse2, L"SSE2" };
+	}
+#endif
+	return { scanScalar, L"scalar" };
+}
+
+static const DHFS4_1_Scanner& getScanner()
+{
+	static const DHFS4_1_Scanner scanner = selectScanner();
+	return scanner;
+}
+
+void scanDhavSignatures(const BYTE* buffer, uint64_t length, std::vector<DHFS4_1_SignatureHit>& hits)
+{
+	getScanner().scan(buffer, 0, length, hits);
+}
+
+const wchar_t* getDhavScannerName()
+{
+	return getScanner().name;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Finds "DHAV" frame headers and "dhav" frame footers in a buffer.
+// The fastest implementation the CPU supports (AVX2, SSE2 or plain C++) is chosen once at runtime.
+
+enum class DHFS4_1_SignatureType : uint8_t {
+	header = 0, // "DHAV"
+	footer = 1 // "dhav"
+};
+
+struct DHFS4_1_SignatureHit {
+	uint32_t offset;
+	DHFS4_1_SignatureType type;
+};
+
+// Appends every signature starting in [0, length - 4] to hits, in ascending order
+void scanDhavSignatures(const BYTE* buffer, uint64_t length, std::vector<DHFS4_1_SignatureHit>& hits);
+
+const wchar_t* getDhavScannerName();
@@ -0,0 +1,19 @@
+#include "pch.h"
+#include "dhfs4_1_scanstate.h"
+
+DHFS4_1_PartitionCheckpoint& DHFS4_1_ScanState::getPartition(uint32_t partitionId)
+{
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
+	if (this->partitions.size() <= partitionId)
+	{
+		this->partitions.resize(partitionId + 1);
+	}
+	return this->partitions[partitionId];
+}
+
+BOOL DHFS4_1_ScanState::isDue() const
+{
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
+	return std::chrono::steady_clock::now() - this->lastSave >= std::chrono::milliseconds(DHFS4_1_CHECKPOINT_INTERVAL);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "dhfs4_1_parser.h"
+
+// How far the scan of each partition got. The core only keeps it in memory,
+// the X-Tension saves it as checkpoint file, see dhfs4_1_checkpoint.h.
+
+#define DHFS4_1_CHECKPOINT_INTERVAL 30000 // ms between two checkpoints while scanning
+
+enum class DHFS4_1_ScanPhase : uint32_t {
+	descriptors = 0, // walking the descriptor table and creating the recordings
+	freeClusters = 1, // carving the free clusters
+	slackSpace = 2, // carving the slack behind the last fragments
+	carvedItems = 3, // creating the carved items
+	done = 4
+};
+
+struct DHFS4_1_PartitionCheckpoint {
+	DHFS4_1_ScanPhase phase = DHFS4_1_ScanPhase::descriptors;
+	uint64_t nextDescriptor = 0; // items of all descriptors below exist
+	uint64_t carveJobsDone = 0; // merged jobs of the carving phase
+	uint64_t carvedItemsDone = 0;
+	int32_t rootId = -1;
+	int32_t carvedRootId = -1;
+	int32_t fileCounter = 0;
+
+	// Merged frames of both carving phases, the carved streams are assembled from them again
+	std::vector<DHFS4_1_Videoframe> freeFrames;
+	std::vector<DHFS4_1_Videoframe> slackFrames;
+};
+
+class DHFS4_1_ScanState
+{
+protected:
+	std::deque<DHFS4_1_PartitionCheckpoint> partitions; // grows at the end, so the workers' references stay valid
+	std::chrono::steady_clock::time_point lastSave = std::chrono::steady_clock::now();
+	mutable std::recursive_mutex mutex;
+
+public:
+	virtual ~DHFS4_1_ScanState() = default;
+
+	// Concurrent partitions change their state while another one saves, both hold this lock
+	std::recursive_mutex& getMutex()
+	{
+		return this->mutex;
+	}
+
+	// Added on the first call, the reference stays valid while other partitions are added
+	DHFS4_1_PartitionCheckpoint& getPartition(uint32_t partitionId);
+
+	// The last save is older than DHFS4_1_CHECKPOINT_INTERVAL
+	BOOL isDue() const;
+
+	// Keeps the state if it's due, or always with force. Only kept in memory without a checkpoint file.
+	virtual BOOL save([[maybe_unused]] BOOL force = false)
+	{
+		return false;
+	}
+};
@@ -0,0 +1,90 @@
+#include "pch.h"
+#include "dhfs4_1_time.h"
+
+static_assert(validateDHFSTime((24u << 26) | (2u << 22) | (29u << 17) | (23u << 12) | (59u << 6) | 59u), "29.02.2024 23:59:59 exists");
+static_assert(!validateDHFSTime((23u << 26) | (2u << 22) | (29u << 17)), "2023 is no leap year");
+static_assert(!validateDHFSTime((24u << 26) | (4u << 22) | (31u << 17)), "April has 30 days");
+static_assert(!validateDHFSTime(0), "year 0 is rejected");
+static_assert(dhfstimeToFiletime((24u << 26) | (2u << 22) | (29u << 17) | (12u << 12)) == 1709208000LL * 10000000LL + DHFS4_1_FILETIME_EPOCH_DIFFERENCE, "29.02.2024 12:00:00 UTC");
+
+size_t validateDHFSTimes(const uint32_t* dhfsTimestamps, size_t count, uint8_t* valid)
+{
+	size_t validCount = 0;
+
+	// Same checks as validateDHFSTime, but without branches, so the compiler can unroll and vectorize the loop
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t dhfsTimestamp = dhfsTimestamps[i];
+		uint32_t year = (dhfsTimestamp >> 26) & 0x3F;
+		uint32_t month = (dhfsTimestamp >> 22) & 0x0F;
+		uint32_t day = (dhfsTimestamp >> 17) & 0x1F;
+		uint32_t hour = (dhfsTimestamp >> 12) & 0x1F;
+		uint32_t minute = (dhfsTimestamp >> 6) & 0x3F;
+		uint32_t second = dhfsTimestamp & 0x3F;
+
+		// Years are 2000 to 2063, there every 4th year is a leap year
+		uint32_t daysInMonth = dhfsDaysPerMonth[month <= 12 ? month : 0] + ((month == 2) & ((year & 3) == 0));
+
+		uint8_t isValid = (year >= 1) & (month >= 1) & (month <= 12) & (day >= 1) & (day <= daysInMonth) &
+			(hour <= 23) & (minute <= 59) & (second <= 59);
+
+		valid[i] = isValid;
+		validCount += isValid;
+	}
+
+	return validCount;
+}
+
+static inline wchar_t* writeDigits(uint32_t value, int width, wchar_t* destination)
+{
+	for (int i = width - 1; i >= 0; i--)
+	{
+		destination[i] = L'0' + value % 10;
+		value /= 10;
+	}
+	return destination + width;
+}
+
+wchar_t* writeDHFSTime(uint32_t dhfsTimestamp, wchar_t* destination)
+{
+	DHFS4_1_Time dhfsTime = convertDfhstime(dhfsTimestamp);
+
+	destination = writeDigits(dhfsTime.day, 2, destination);
+	*destination++ = L'.';
+	destination = writeDigits(dhfsTime.month, 2, destination);
+	*destination++ = L'.';
+	destination = writeDigits(dhfsTime.year + 2000, 4, destination);
+	*destination++ = L'_';
+	destination = writeDigits(dhfsTime.hour, 2, destination);
+	*destination++ = L':';
+	destination = writeDigits(dhfsTime.minute, 2, destination);
+	*destination++ = L':';
+	destination = writeDigits(dhfsTime.second, 2, destination);
+
+	return destination;
+}
+
+const wchar_t* formatVideoName(uint8_t camera, uint32_t beginDate, uint32_t endDate, wchar_t (&name)[DHFS4_1_VIDEO_NAME_LENGTH])
+{
+	wchar_t* position = name;
+
+	*position++ = L'C';
+	*position++ = L'h';
+	*position++ = L'_';
+	position = writeDigits(camera, camera >= 100 ? 3 : camera >= 10 ? 2 : 1, position);
+	*position++ = L'_';
+	position = writeDHFSTime(beginDate, position);
+	*position++ = L'-';
+	position = writeDHFSTime(endDate, position);
+	wmemcpy(position, L".dav", 5);
+
+	return name;
+}
+
+std::wstring dhfstimeToWString(uint32_t dhfsTimestamp)
+{
+	wchar_t timeString[DHFS4_1_TIME_STRING_LENGTH];
+	writeDHFSTime(dhfsTimestamp, timeString);
+
+	return std::wstring(timeString, DHFS4_1_TIME_STRING_LENGTH);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// DHFS timestamps are bit-packed local times:
+// 6 bits year since 2000, 4 bits month, 5 bits day, 5 bits hour, 6 bits minute, 6 bits seconds
+
+struct DHFS4_1_Time {
+	uint32_t year;
+	uint8_t month;
+	uint8_t day;
+	uint8_t hour;
+	uint8_t minute;
+	uint8_t second;
+};
+
+constexpr uint8_t dhfsDaysPerMonth[13] = { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+constexpr DHFS4_1_Time convertDfhstime(uint32_t dhfsTimestamp)
+{
+	DHFS4_1_Time dhfsTime = {};
+	dhfsTime.year = (dhfsTimestamp >> (31 + 1 - 6)) & ((1u << 6) - 1); // 6 bits year
+	dhfsTime.month = (dhfsTimestamp >> (25 + 1 - 4)) & ((1u << 4) - 1); // 4 bits month
+	dhfsTime.day = (dhfsTimestamp >> (21 + 1 - 5)) & ((1u << 5) - 1); // 5 bits day
+	dhfsTime.hour = (dhfsTimestamp >> (16 + 1 - 5)) & ((1u << 5) - 1); // 5 bits hour
+	dhfsTime.minute = (dhfsTimestamp >> (11 + 1 - 6)) & ((1u << 6) - 1); // 6 bits minute
+	dhfsTime.second = (dhfsTimestamp >> (5 + 1 - 6)) & ((1u << 6) - 1); // 6 bits seconds
+
+	return dhfsTime;
+}
+
+constexpr BOOL isDHFSLeapYear(uint32_t year)
+{
+	year += 2000;
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// Plain calendar check, no CRT time functions, so it's cheap enough for every carved frame
+constexpr BOOL validateDHFSTime(uint32_t dhfsTimestamp)
+{
+	DHFS4_1_Time dhfsTime = convertDfhstime(dhfsTimestamp);
+
+	// filter dates that make no sense
+	if (dhfsTime.year < 1 ||
+		dhfsTime.month < 1 ||
+		dhfsTime.month > 12 ||
+		dhfsTime.day < 1 ||
+		dhfsTime.hour > 23 ||
+		dhfsTime.minute > 59 ||
+		dhfsTime.second > 59)
+	{
+		return false;
+	}
+
+	uint32_t daysInMonth = dhfsDaysPerMonth[dhfsTime.month] + (dhfsTime.month == 2 && isDHFSLeapYear(dhfsTime.year) ? 1 : 0);
+
+	return dhfsTime.day <= daysInMonth;
+}
+
+// Validates count timestamps at once, valid[i] is 1 or 0. Returns the number of valid timestamps.
+size_t validateDHFSTimes(const uint32_t* dhfsTimestamps, size_t count, uint8_t* valid);
+
+#define DHFS4_1_FILETIME_EPOCH_DIFFERENCE 116444736000000000LL // 100ns intervals from 1601 to 1970
+#define DHFS4_1_TIME_STRING_LENGTH 19 // DD.MM.YYYY_hh:mm:ss
+#define DHFS4_1_VIDEO_NAME_LENGTH 64 // Ch_<camera>_<begin>-<end>.dav with terminating zero
+
+// Days since 01.01.1970 in the proleptic gregorian calendar, days and months out of range are carried over like _mkgmtime does
+constexpr int64_t daysFromCivil(int64_t year, int64_t month, int64_t day)
+{
+	year += (month - 1 >= 0 ? (month - 1) / 12 : (month - 12) / 12);
+	month = ((month - 1) % 12 + 12) % 12 + 1;
+
+	// Years start in March, so the leap day is the last day of the year
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t yearOfEra = year - era * 400;
+	int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+	return era * 146097 + dayOfEra - 719468;
+}
+
+// The DHFS time is taken as UTC, X-Ways shows it in the time zone of the case
+constexpr INT64 dhfstimeToFiletime(uint32_t dhfsTimestamp)
+{
+	DHFS4_1_Time dhfsTime = convertDfhstime(dhfsTimestamp);
+
+	int64_t unixtime = daysFromCivil(dhfsTime.year + 2000, dhfsTime.month, dhfsTime.day) * 86400 +
+		dhfsTime.hour * 3600 + dhfsTime.minute * 60 + dhfsTime.second;
+
+	return unixtime * 10000000LL + DHFS4_1_FILETIME_EPOCH_DIFFERENCE;
+}
+
+// Writes DD.MM.YYYY_hh:mm:ss without a terminating zero, returns the position behind it.
+// All fields fit into their width, so the length is always the same.
+wchar_t* writeDHFSTime(uint32_t dhfsTimestamp, wchar_t* destination);
+
+// Ch_<camera>_<begin>-<end>.dav into a buffer the caller keeps, so no string is allocated per item
+const wchar_t* formatVideoName(uint8_t camera, uint32_t beginDate, uint32_t endDate, wchar_t (&name)[DHFS4_1_VIDEO_NAME_LENGTH]);
+
+std::wstring dhfstimeToWString(uint32_t dhfsTimestamp);
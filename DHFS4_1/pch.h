@@ -8,8 +8,10 @@
 #define PCH_H
 
 // Fügen Sie hier Header hinzu, die vorkompiliert werden sollen.
+#ifdef _WIN32
 #include "framework.h"
 #include "X-Tension.h"
+#endif
 #include <wchar.h>
 #include <string>
 #include <cstdint>
@@ -18,13 +20,33 @@
 #include <stdlib.h>
 #include <ctime>
 #include <unordered_map>
+#ifdef _WIN32
 #include <format>
+#endif
 #include <bitset>
 #include <chrono>
 #include <ctime>
 #include <cstdint>
 #include <set>
+#include <algorithm>
+#include <mutex>
+#include <list>
+#include <deque>
+#include <atomic>
+#include <new>
+#include <bit>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <string_view>
+#include <span>
+#include <cstring>
 
+#ifdef _WIN32
 #define timegm _mkgmtime
+#else
+// Parser core without windows.h, see CMakeLists.txt
+#include "dhfs4_1_platform.h"
+#endif
 
 #endif //PCH_H